@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#include "lab6/winogradMultiplication.cpp"
+#include "lab6/winogradVectorized.cpp"
+#include "lab6/recursiveMultiplication.cpp"
+#include "lab6/recursiveMultiplicationInPlace.cpp"
+#include "lab6/strassenMultiplication.cpp"
+#include "lab6/numaMultiplication.cpp"
+#include "lab6/mixedPrecision.cpp"
+#include "lab6/autotune.cpp"
+#include "lab6/asyncMultiplication.cpp"
+#include "lab6/structuredMultiplication.cpp"
+#include "lab6/distributedMultiplication.cpp"
+#include "lab6/benchmark.h"
+
+const int defaultSizes[] = {8,16,32,50,100,150,256,300,512,600,700,800,900,1024,1500};
+
+void kernelMultiply(Matrix &result, const Matrix &first, const Matrix &second) {
+    kernel::multiply(result, first, second);
+}
+
+// operands rounded on every call, the conversion is part of the time
+void mixedFloat(Matrix &result, const Matrix &first, const Matrix &second) {
+    mixed::Options options;
+    options.samples = 0;
+    mixed::multiply(result, first, second, options);
+}
+
+void mixedBfloat16(Matrix &result, const Matrix &first, const Matrix &second) {
+    mixed::Options options;
+    options.storage = mixed::BFLOAT16;
+    options.samples = 0;
+    mixed::multiply(result, first, second, options);
+}
+
+std::vector<benchmark::Engine> engines() {
+    const benchmark::Engine list[] = {
+            {"kernel",                      &kernelMultiply,                       NULL, false},
+            {"winograd.serial",             &winograd::multiplySerial,             NULL, false},
+            {"winograd.parallel",           &winograd::multiplyParallel,           NULL, true},
+            {"winograd.vectorized",         &winograd::multiplyVectorized,         NULL, false},
+            {"winograd.vectorizedParallel", &winograd::multiplyVectorizedParallel, NULL, true},
+            {"recursive.serial",            &recursive::multiplySerial,            NULL, false},
+            {"recursive.parallel",          &recursive::multiplyParallel,          NULL, true},
+            {"recursiveInPlace.serial",     &recursiveInPlace::multiplySerial,     NULL, false},
+            {"recursiveInPlace.parallel",   &recursiveInPlace::multiplyParallel,   NULL, true},
+            {"recursiveInPlace.mortonSerial",   &recursiveInPlace::multiplyMortonSerial,   NULL, false},
+            {"recursiveInPlace.mortonParallel", &recursiveInPlace::multiplyMortonParallel, NULL, true},
+            {"strassen.serial",             &strassen::multiplySerial,             NULL, false},
+            {"numa.parallel",               &numa::multiply,                       NULL, true},
+            {"mixed.float",                 &mixedFloat,                           NULL, true, 1e-5},
+            {"mixed.bfloat16",              &mixedBfloat16,                        NULL, true, 5e-2},
+            {"autotune",                    &autotune::multiply,                   NULL, true},
+            {"async.parallel",              &async::multiplyParallel,              NULL, true},
+            {"structured",                  &structured::multiply,                 NULL, true},
+            {"distributed",                 &distributed::multiply,                NULL, false},
+            {"winograd.serial[]",           NULL, &winograd::multiplySerial,             false},
+            {"winograd.parallel[]",         NULL, &winograd::multiplyParallel,           true},
+            {"winograd.vectorized[]",       NULL, &winograd::multiplyVectorized,         false},
+            {"winograd.vectorizedParallel[]", NULL, &winograd::multiplyVectorizedParallel, true},
+            {"recursive.serial[]",          NULL, &recursive::multiplySerial,            false},
+            {"recursive.parallel[]",        NULL, &recursive::multiplyParallel,          true},
+            {"recursiveInPlace.serial[]",   NULL, &recursiveInPlace::multiplySerial,     false},
+            {"recursiveInPlace.parallel[]", NULL, &recursiveInPlace::multiplyParallel,   true},
+            {"strassen.serial[]",           NULL, &strassen::multiplySerial,             false},
+            {"numa.parallel[]",             NULL, &numa::multiply,                       true},
+            {"structured[]",                NULL, &structured::multiply,                 true},
+    };
+    return std::vector<benchmark::Engine>(list, list + sizeof(list) / sizeof(list[0]));
+}
+
+std::vector<std::string> split(const char *text) {
+    std::vector<std::string> parts;
+    std::string current;
+    for (const char *c = text; ; ++c) {
+        if (*c == ',' || *c == '\0') {
+            if (!current.empty()) {
+                parts.push_back(current);
+            }
+            current.clear();
+            if (*c == '\0') {
+                break;
+            }
+        } else {
+            current += *c;
+        }
+    }
+    return parts;
+}
+
+std::vector<int> splitInts(const char *text) {
+    const std::vector<std::string> parts = split(text);
+    std::vector<int> values;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        values.push_back(atoi(parts[i].c_str()));
+    }
+    return values;
+}
+
+void usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --sizes 8,16,...      square sizes (default: 8 .. 1500)\n"
+            "  --threads 1,2,4       thread counts for the parallel engines (default: max)\n"
+            "  --engines a,b         engine names, see --list (default: all)\n"
+            "  --warmup N            untimed runs per case (default: 1)\n"
+            "  --repeats N           timed runs per case (default: 5)\n"
+            "  --seed N              input generator seed (default: 42)\n"
+            "  --tolerance X         max relative error vs the kernel (default: 1e-9;\n"
+            "                        mixed.* engines check against their own)\n"
+            "  --format csv|json     output format (default: csv)\n"
+            "  --output FILE         write results to FILE instead of stdout\n"
+            "  --no-pin              leave threads unbound\n"
+            "  --list                print engine names and exit\n"
+            "  --tune FILE           tune engine parameters for --sizes (default: 64 .. 2048)\n"
+            "                        and --threads, write them to FILE and exit\n"
+            "  --tuning FILE         table for the autotune engine (default: $MATRIX_TUNING_FILE\n"
+            "                        or autotune.txt)\n"
+            "  --processes N         ranks of the distributed engine (default: 4)\n", program);
+}
+
+int main(int argc, char **argv) {
+    benchmark::Options options;
+    const char *output = NULL;
+    const char *tuneOutput = NULL;
+    const char *tuning = autotune::defaultPath();
+    const std::vector<benchmark::Engine> all = engines();
+
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--sizes") && hasValue) {
+            options.sizes = splitInts(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && hasValue) {
+            options.threads = splitInts(argv[++i]);
+        } else if (!strcmp(argv[i], "--engines") && hasValue) {
+            options.engines = split(argv[++i]);
+        } else if (!strcmp(argv[i], "--warmup") && hasValue) {
+            options.warmup = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--repeats") && hasValue) {
+            options.repeats = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && hasValue) {
+            options.seed = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--tolerance") && hasValue) {
+            options.tolerance = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--format") && hasValue) {
+            options.format = argv[++i];
+        } else if (!strcmp(argv[i], "--output") && hasValue) {
+            output = argv[++i];
+        } else if (!strcmp(argv[i], "--no-pin")) {
+            options.pin = false;
+        } else if (!strcmp(argv[i], "--tune") && hasValue) {
+            tuneOutput = argv[++i];
+        } else if (!strcmp(argv[i], "--tuning") && hasValue) {
+            tuning = argv[++i];
+        } else if (!strcmp(argv[i], "--processes") && hasValue) {
+            distributed::processes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--list")) {
+            for (size_t e = 0; e < all.size(); ++e) {
+                printf("%s\n", all[e].name.c_str());
+            }
+            return 0;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.repeats < 1 || distributed::processes < 1 || (options.format != "csv" && options.format != "json")) {
+        usage(argv[0]);
+        return 2;
+    }
+    for (size_t e = 0; e < options.engines.size(); ++e) {
+        bool known = false;
+        for (size_t i = 0; i < all.size(); ++i) {
+            known = known || all[i].name == options.engines[e];
+        }
+        if (!known) {
+            fprintf(stderr, "unknown engine %s\n", options.engines[e].c_str());
+            return 2;
+        }
+    }
+
+    // the OpenMP runtime reads its environment at load time, so pinning has
+    // to be in place before the process starts: set it and restart once
+    if (options.pin && getenv("OMP_PROC_BIND") == NULL) {
+        setenv("OMP_PROC_BIND", "close", 1);
+        if (getenv("OMP_PLACES") == NULL) {
+            setenv("OMP_PLACES", "cores", 1);
+        }
+#ifdef __linux__
+        execv("/proc/self/exe", argv);
+#endif
+    }
+    if (tuneOutput != NULL) {
+        autotune::Options tuneOptions;
+        if (!options.sizes.empty()) {
+            tuneOptions.sizes = options.sizes;
+        }
+        if (!options.threads.empty()) {
+            tuneOptions.threads = options.threads;
+        }
+        tuneOptions.repeats = options.repeats;
+        tuneOptions.seed = options.seed;
+        tuneOptions.log = stderr;
+        if (!autotune::tuneAndSave(tuneOutput, tuneOptions)) {
+            fprintf(stderr, "cannot write %s\n", tuneOutput);
+            return 2;
+        }
+        autotune::writeTable(stdout, autotune::table());
+        return 0;
+    }
+    if (!autotune::load(tuning)) {
+        fprintf(stderr, "no tuning table in %s, autotune runs the blocked kernel\n", tuning);
+    }
+    if (options.sizes.empty()) {
+        options.sizes.assign(defaultSizes, defaultSizes + sizeof(defaultSizes) / sizeof(defaultSizes[0]));
+    }
+    if (options.threads.empty()) {
+        options.threads.push_back(omp_get_max_threads());
+    }
+
+    FILE *out = output != NULL ? fopen(output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot open %s\n", output);
+        return 2;
+    }
+    fprintf(stderr, "vector level: %s\n", winograd::vectorLevel());
+#ifdef PERF_COUNTERS
+    if (!perf::ProcessCounters().available()) {
+        fprintf(stderr, "perf_event_open unavailable (check kernel.perf_event_paranoid), counters left empty\n");
+    }
+#endif
+    const std::vector<benchmark::Result> results = benchmark::run(all, options);
+    benchmark::write(out, results, options);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (!results[i].correct) {
+            return 1;
+        }
+    }
+    return 0;
+}
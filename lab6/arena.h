@@ -0,0 +1,104 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "matrix.h"
+
+/* Stack (bump) allocator
+*       allocate() moves the top up, release(mark) drops everything allocated
+*       since mark() in one step, so nested callers free in LIFO order
+*   The buffer is reserved once; pages are only touched as the top passes
+*   over them, so a generously sized arena costs address space, not memory.
+*/
+class Arena {
+public:
+    explicit Arena(const size_t capacity = 0) : base(NULL), capacity(0), top(0), highWater(0) {
+        reserve(capacity);
+    }
+
+    ~Arena() {
+        alignedFree(base);
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // only valid while nothing is allocated
+    void reserve(const size_t bytes) {
+        if (bytes > capacity) {
+            alignedFree(base);
+            base = (char *) alignedMalloc(bytes);
+            capacity = bytes;
+        }
+        top = 0;
+    }
+
+    void *allocate(const size_t bytes) {
+        const size_t start = (top + MATRIX_ALIGNMENT - 1) & ~(size_t) (MATRIX_ALIGNMENT - 1);
+        if (start + bytes > capacity) {
+            fprintf(stderr, "arena exhausted: %lu of %lu bytes\n",
+                    (unsigned long) (start + bytes), (unsigned long) capacity);
+            abort();
+        }
+        top = start + bytes;
+        if (top > highWater) {
+            highWater = top;
+        }
+        return base + start;
+    }
+
+    size_t mark() const {
+        return top;
+    }
+
+    void release(const size_t mark) {
+        top = mark;
+    }
+
+    // largest top seen since construction
+    size_t peak() const {
+        return highWater;
+    }
+
+    // bytes allocate() may consume for a block of the given size, padding included
+    static size_t footprint(const size_t bytes) {
+        return bytes + MATRIX_ALIGNMENT - 1;
+    }
+
+private:
+    char *base;
+    size_t capacity;
+    size_t top;
+    size_t highWater;
+};
+
+// same layout as createMatrix (row table followed by the rows), carved from arena
+template <typename T = double>
+T **createMatrix(Arena &arena, const int sizeA, const int sizeB) {
+    T **matrix = (T **) arena.allocate(sizeA * sizeof(T *) + (size_t) sizeA * sizeB * sizeof(T));
+    T *rows = (T *) (matrix + sizeA);
+    for (int i = 0; i < sizeA; ++i) {
+        matrix[i] = rows + (size_t) i * sizeB;
+    }
+    return matrix;
+}
+
+template <typename T = double>
+size_t arenaArrayBytes(const int sizeA, const int sizeB) {
+    return Arena::footprint(sizeA * sizeof(T *) + (size_t) sizeA * sizeB * sizeof(T));
+}
+
+// non-owning matrix over arena memory
+template <typename T = double>
+BasicMatrix<T> arenaMatrix(Arena &arena, const int rows, const int cols) {
+    const int stride = BasicMatrix<T>::paddedStride(cols);
+    return BasicMatrix<T>((T *) arena.allocate((size_t) rows * stride * sizeof(T)), rows, cols, stride);
+}
+
+template <typename T = double>
+size_t arenaMatrixBytes(const int rows, const int cols) {
+    return Arena::footprint((size_t) rows * BasicMatrix<T>::paddedStride(cols) * sizeof(T));
+}
+
+#endif
@@ -0,0 +1,331 @@
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "matrix.h"
+#include "gemmKernel.h"
+#include "scheduler.h"
+
+/* Cormen, Leiserson, Rivest, Stein. Introduction to Algorithms, 2nd Ed.
+* Chapter 15.  Dynamic Programming
+*       15.2 Matrix-chain multiplication
+* Asynchronous multiplication on the shared work-stealing pool (scheduler.h)
+*       Future<T> f = async::multiply(A, B)                 one product
+*       Future<T> f = async::multiplyChain({&A, &B, &C})    A * B * C
+*   Both return at once: the work is queued on the pool, so products
+*   submitted one after the other run side by side without a parallel region
+*   of their own, and f.get() blocks until the product is there.
+*   A chain is evaluated as a tree of products in the cheapest order for the
+*   actual shapes (chainOrder()). Every product is cut into tileRows x
+*   tileCols tiles, one task each. Row panel p of left * right only needs
+*   row panel p of left and all of right, so a panel is queued as soon as
+*   those are done: (A * B) * C starts on the first rows of A * B while
+*   the later ones are still being computed. Intermediate products are freed
+*   once the product that consumes them is complete.
+*   Inputs are not copied and must outlive the future; the pool must not be
+*   replaced (scheduler::setThreads) while a future is pending.
+*/
+namespace async {
+    // one task computes a tileRows x tileCols block of a product
+    int tileRows = 128;
+    int tileCols = 512;
+
+    /* Matrix-chain order
+    *       factor i is dims[i] x dims[i + 1], i < dims.size() - 1
+    *       cost        scalar multiplications of the best order, m[1, n]
+    *       split[i][j] factors i .. j are multiplied as (i .. s) * (s + 1 .. j)
+    */
+    struct ChainOrder {
+        double cost;
+        std::vector<std::vector<int> > split;
+    };
+
+    ChainOrder chainOrder(const std::vector<int> &dims) {
+        const int n = (int) dims.size() - 1;
+        ChainOrder order;
+        order.cost = 0;
+        if (n < 1) {
+            return order;
+        }
+        std::vector<std::vector<double> > cost(n, std::vector<double>(n, 0));
+        order.split.assign(n, std::vector<int>(n, 0));
+        for (int length = 2; length <= n; ++length) {
+            for (int i = 0; i + length - 1 < n; ++i) {
+                const int j = i + length - 1;
+                cost[i][j] = -1;
+                for (int s = i; s < j; ++s) {
+                    const double c = cost[i][s] + cost[s + 1][j] + (double) dims[i] * dims[s + 1] * dims[j + 1];
+                    if (cost[i][j] < 0 || c < cost[i][j]) {
+                        cost[i][j] = c;
+                        order.split[i][j] = s;
+                    }
+                }
+            }
+        }
+        order.cost = cost[0][n - 1];
+        return order;
+    }
+
+    // one factor (left == NULL) or one product of the evaluation tree
+    template <typename T>
+    struct Node {
+        BasicMatrix<T> value;       // a view for factors, owned for products
+        Node *left;
+        Node *right;
+        Node *parent;
+        int panels;                 // row panels of tileRows
+        int blocks;                 // column blocks of tileCols
+        std::unique_ptr<std::atomic<int>[]> waiting;    // per panel: operands not ready, +1 until started
+        std::unique_ptr<std::atomic<int>[]> pending;    // per panel: tiles not done
+        std::atomic<int> panelsLeft;
+
+        Node() : left(NULL), right(NULL), parent(NULL), panels(0), blocks(0), panelsLeft(0) {}
+    };
+
+    // everything one future refers to, kept alive by the queued tasks
+    template <typename T>
+    struct Plan {
+        scheduler::WorkStealingPool &pool;
+        const int tileRows;
+        const int tileCols;
+        std::vector<std::unique_ptr<Node<T> > > nodes;
+        Node<T> *root;
+        std::atomic<bool> done;
+        std::mutex doneLock;
+        std::condition_variable doneSignal;
+
+        Plan() : pool(scheduler::pool()), tileRows(async::tileRows), tileCols(async::tileCols),
+                 root(NULL), done(false) {}
+
+        Node<T> *add() {
+            nodes.push_back(std::unique_ptr<Node<T> >(new Node<T>()));
+            return nodes.back().get();
+        }
+    };
+
+    template <typename T>
+    class Future {
+    public:
+        Future() {}
+
+        explicit Future(const std::shared_ptr<Plan<T> > &plan) : plan(plan) {}
+
+        // false for a default constructed future or a chain whose shapes do not match
+        bool valid() const {
+            return plan != NULL;
+        }
+
+        // false for an invalid future as well
+        bool ready() const {
+            return valid() && plan->done.load();
+        }
+
+        // a pool worker runs queued tasks meanwhile instead of blocking; valid futures only
+        void wait() const {
+            assert(valid());
+            if (plan->pool.workerId() >= 0) {
+                while (!plan->done.load()) {
+                    if (!plan->pool.runOne(-1)) {
+                        std::this_thread::yield();
+                    }
+                }
+                return;
+            }
+            std::unique_lock<std::mutex> lock(plan->doneLock);
+            plan->doneSignal.wait(lock, [this]() { return plan->done.load(); });
+        }
+
+        // valid as long as this future (or a copy of it) is; valid futures only
+        const BasicMatrix<T> &get() const {
+            assert(valid());
+            wait();
+            return plan->root->value;
+        }
+
+    private:
+        std::shared_ptr<Plan<T> > plan;
+    };
+
+    template <typename T>
+    static void queuePanel(const std::shared_ptr<Plan<T> > &plan, Node<T> *node, const int panel);
+
+    template <typename T>
+    static void finish(const std::shared_ptr<Plan<T> > &plan) {
+        std::lock_guard<std::mutex> guard(plan->doneLock);
+        plan->done = true;
+        plan->doneSignal.notify_all();
+    }
+
+    // one operand of panel `panel` of node is ready
+    template <typename T>
+    static void ready(const std::shared_ptr<Plan<T> > &plan, Node<T> *node, const int panel) {
+        if (--node->waiting[panel] == 0) {
+            queuePanel(plan, node, panel);
+        }
+    }
+
+    template <typename T>
+    static void nodeDone(const std::shared_ptr<Plan<T> > &plan, Node<T> *node) {
+        // intermediate operands are not read any more
+        if (node->left->left != NULL) {
+            node->left->value = BasicMatrix<T>();
+        }
+        if (node->right->left != NULL) {
+            node->right->value = BasicMatrix<T>();
+        }
+        Node<T> *parent = node->parent;
+        if (parent == NULL) {
+            finish(plan);
+        } else if (parent->right == node) {
+            for (int p = 0; p < parent->panels; ++p) {
+                ready(plan, parent, p);
+            }
+        }
+    }
+
+    template <typename T>
+    static void panelDone(const std::shared_ptr<Plan<T> > &plan, Node<T> *node, const int panel) {
+        Node<T> *parent = node->parent;
+        if (parent != NULL && parent->left == node) {
+            ready(plan, parent, panel);
+        }
+        if (--node->panelsLeft == 0) {
+            nodeDone(plan, node);
+        }
+    }
+
+    template <typename T>
+    static void runTile(const std::shared_ptr<Plan<T> > &plan, Node<T> *node, const int panel, const int block) {
+        const BasicMatrix<T> &left = node->left->value, &right = node->right->value;
+        const int i = panel * plan->tileRows, j = block * plan->tileCols;
+        const int rows = std::min(plan->tileRows, node->value.rows - i);
+        const int cols = std::min(plan->tileCols, node->value.cols - j);
+        kernel::multiply(node->value.view(i, j, rows, cols),
+                left.view(i, 0, rows, left.cols), right.view(0, j, right.rows, cols));
+        if (--node->pending[panel] == 0) {
+            panelDone(plan, node, panel);
+        }
+    }
+
+    template <typename T>
+    static void queuePanel(const std::shared_ptr<Plan<T> > &plan, Node<T> *node, const int panel) {
+        for (int b = 0; b < node->blocks; ++b) {
+            scheduler::Task task;
+            task.depth = 0;
+            task.run = [plan, node, panel, b]() { runTile(plan, node, panel, b); };
+            plan->pool.push(task);
+        }
+    }
+
+    // node = left * right into storage already set in node->value
+    template <typename T>
+    static void prepare(const Plan<T> &plan, Node<T> *node, Node<T> *left, Node<T> *right) {
+        node->left = left;
+        node->right = right;
+        left->parent = node;
+        right->parent = node;
+        const int rows = node->value.rows, cols = node->value.cols;
+        node->panels = std::max(1, (rows + plan.tileRows - 1) / plan.tileRows);
+        node->blocks = std::max(1, (cols + plan.tileCols - 1) / plan.tileCols);
+        node->waiting.reset(new std::atomic<int>[node->panels]);
+        node->pending.reset(new std::atomic<int>[node->panels]);
+        const int operands = (left->left != NULL ? 1 : 0) + (right->left != NULL ? 1 : 0);
+        for (int p = 0; p < node->panels; ++p) {
+            node->waiting[p] = operands + 1;
+            node->pending[p] = node->blocks;
+        }
+        node->panelsLeft = node->panels;
+    }
+
+    template <typename T>
+    static Node<T> *factor(Plan<T> &plan, const BasicMatrix<T> &matrix) {
+        Node<T> *node = plan.add();
+        node->value = matrix.view(0, 0, matrix.rows, matrix.cols);
+        return node;
+    }
+
+    template <typename T>
+    static Node<T> *build(Plan<T> &plan, const std::vector<const BasicMatrix<T> *> &factors,
+            const ChainOrder &order, const int i, const int j) {
+        if (i == j) {
+            return factor(plan, *factors[i]);
+        }
+        const int s = order.split[i][j];
+        Node<T> *left = build(plan, factors, order, i, s);
+        Node<T> *right = build(plan, factors, order, s + 1, j);
+        Node<T> *node = plan.add();
+        node->value = BasicMatrix<T>(factors[i]->rows, factors[j]->cols);
+        prepare(plan, node, left, right);
+        return node;
+    }
+
+    // queues the first tiles, the rest follow as their operands complete
+    template <typename T>
+    static Future<T> start(const std::shared_ptr<Plan<T> > &plan) {
+        if (plan->root->left == NULL) {
+            finish(plan);
+        }
+        for (size_t n = 0; n < plan->nodes.size(); ++n) {
+            Node<T> *node = plan->nodes[n].get();
+            for (int p = 0; node->left != NULL && p < node->panels; ++p) {
+                ready(plan, node, p);
+            }
+        }
+        return Future<T>(plan);
+    }
+
+    // first * second, first.cols == second.rows
+    template <typename T>
+    Future<T> multiply(const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        std::shared_ptr<Plan<T> > plan(new Plan<T>());
+        Node<T> *left = factor(*plan, first);
+        Node<T> *right = factor(*plan, second);
+        plan->root = plan->add();
+        plan->root->value = BasicMatrix<T>(first.rows, second.cols);
+        prepare(*plan, plan->root, left, right);
+        return start(plan);
+    }
+
+    // factors[0] * factors[1] * .., invalid future if two neighbours do not fit
+    template <typename T>
+    Future<T> multiplyChain(const std::vector<const BasicMatrix<T> *> &factors) {
+        if (factors.empty()) {
+            return Future<T>();
+        }
+        std::vector<int> dims(1, factors[0]->rows);
+        for (size_t i = 0; i < factors.size(); ++i) {
+            if (factors[i]->rows != dims.back()) {
+                return Future<T>();
+            }
+            dims.push_back(factors[i]->cols);
+        }
+        const ChainOrder order = chainOrder(dims);
+        std::shared_ptr<Plan<T> > plan(new Plan<T>());
+        plan->root = build(*plan, factors, order, 0, (int) factors.size() - 1);
+        if (plan->root->left == NULL) {
+            // a chain of one: the result is a copy, not a view of the input
+            const BasicMatrix<T> &only = *factors[0];
+            plan->root->value = BasicMatrix<T>(only.rows, only.cols);
+            for (int i = 0; i < only.rows; ++i) {
+                std::copy(only[i], only[i] + only.cols, plan->root->value[i]);
+            }
+        }
+        return start(plan);
+    }
+
+    // blocking, with the signature of the other engines: tiles go straight into result
+    template <typename T>
+    void multiplyParallel(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        std::shared_ptr<Plan<T> > plan(new Plan<T>());
+        Node<T> *left = factor(*plan, first);
+        Node<T> *right = factor(*plan, second);
+        plan->root = plan->add();
+        plan->root->value = result.view(0, 0, result.rows, result.cols);
+        prepare(*plan, plan->root, left, right);
+        start(plan).wait();
+    }
+}
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <omp.h>
+#include "matrix.h"
+#include "utils.h"
+#include "gemmKernel.h"
+#include "scheduler.h"
+#include "benchmark.h"
+
+/* Autotuner and front door
+*       tune()      times every engine with every candidate parameter set
+*                   (recursion cutoff, parallel grain, kernel blocking, thread
+*                   count) on random square inputs of each size, and keeps the
+*                   fastest correct one per size
+*       save/load   one line per size in a text file, see writeTable()
+*       multiply()  picks the entry whose size is nearest (in log scale) to
+*                   the cube root of m k n, sets its parameters and calls its
+*                   engine; without a table the blocked kernel runs
+*   The search is greedy: the kernel blocking is tuned first and then reused
+*   by every engine at that size, since they all end in the kernel.
+*   Parameters are process-wide globals (recursive::cutoff, kernel::MC, ...),
+*   so multiply() must not run concurrently with differently tuned calls.
+*   Tables are tuned on double; other element types reuse the choice, the
+*   NUMA engine (double only) is replaced by the in-place recursion for them.
+*   Include after the engines: winogradVectorized, recursive*, strassen, numa.
+*/
+namespace autotune {
+    enum EngineId {
+        KERNEL,
+        WINOGRAD,
+        RECURSIVE,
+        RECURSIVE_IN_PLACE,
+        STRASSEN,
+        NUMA,
+        ENGINES
+    };
+
+    const char *const engineNames[ENGINES] = {
+            "kernel", "winograd.vectorized", "recursive", "recursiveInPlace", "strassen", "numa"
+    };
+
+    struct Config {
+        int size;
+        int engine;
+        int threads;        // 1: the serial variant
+        int cutoff;         // recursive*, strassen
+        int grain;          // recursive*, parallel only
+        int mc, kc, nc;     // kernel blocking
+        double seconds;     // median time at size when tuned
+    };
+
+    struct Options {
+        std::vector<int> sizes;
+        std::vector<int> threads;
+        int repeats;
+        uint64_t seed;
+        double tolerance;
+        FILE *log;          // one line per timed candidate, NULL: quiet
+
+        Options() : repeats(3), seed(42), tolerance(1e-9), log(NULL) {
+            const int defaultSizes[] = {64, 128, 256, 512, 1024, 2048};
+            sizes.assign(defaultSizes, defaultSizes + 6);
+            threads.push_back(omp_get_max_threads());
+        }
+    };
+
+    // candidate parameter values
+    const int kernelMc[] = {64, 128, 256};
+    const int kernelKc[] = {128, 256, 512};
+    const int recursionCutoffs[] = {32, 64, 128, 256};
+    const int recursionGrains[] = {64, 128, 256};
+    const int strassenCutoffs[] = {64, 128, 256, 512};
+
+    static std::vector<Config> &table() {
+        static std::vector<Config> entries;
+        return entries;
+    }
+
+    static Config defaultConfig() {
+        const Config config = {0, KERNEL, 1, 64, 128, kernel::MC, kernel::KC, kernel::NC, 0};
+        return config;
+    }
+
+    // $MATRIX_TUNING_FILE, else autotune.txt in the working directory
+    const char *defaultPath() {
+        const char *path = getenv("MATRIX_TUNING_FILE");
+        return path != NULL ? path : "autotune.txt";
+    }
+
+    static int hostCpus() {
+        const int count = (int) std::thread::hardware_concurrency();
+        return count > 0 ? count : 1;
+    }
+
+    /* Text format
+    *       # autotune 1 cpus=<logical cpus of the tuning host>
+    *       # size engine threads cutoff grain mc kc nc seconds
+    *       <one line per size, sizes ascending>
+    */
+    void writeTable(FILE *out, const std::vector<Config> &configs) {
+        fprintf(out, "# autotune 1 cpus=%d\n", hostCpus());
+        fprintf(out, "# size engine threads cutoff grain mc kc nc seconds\n");
+        for (size_t i = 0; i < configs.size(); ++i) {
+            const Config &c = configs[i];
+            fprintf(out, "%d %s %d %d %d %d %d %d %.6e\n", c.size, engineNames[c.engine], c.threads,
+                    c.cutoff, c.grain, c.mc, c.kc, c.nc, c.seconds);
+        }
+    }
+
+    bool save(const char *path, const std::vector<Config> &configs) {
+        FILE *out = fopen(path, "w");
+        if (out == NULL) {
+            return false;
+        }
+        writeTable(out, configs);
+        return fclose(out) == 0;
+    }
+
+    /* Replaces the table; false (table unchanged) if the file is missing or
+    *   malformed, or was tuned on a host with a different cpu count
+    */
+    bool load(const char *path) {
+        FILE *in = fopen(path, "r");
+        if (in == NULL) {
+            return false;
+        }
+        std::vector<Config> configs;
+        char line[256];
+        bool valid = true;
+        while (valid && fgets(line, sizeof(line), in) != NULL) {
+            int cpus;
+            if (sscanf(line, "# autotune 1 cpus=%d", &cpus) == 1) {
+                valid = cpus == hostCpus();
+                continue;
+            }
+            if (line[0] == '#' || line[0] == '\n') {
+                continue;
+            }
+            Config c;
+            char name[64];
+            valid = sscanf(line, "%d %63s %d %d %d %d %d %d %lf", &c.size, name, &c.threads,
+                    &c.cutoff, &c.grain, &c.mc, &c.kc, &c.nc, &c.seconds) == 9
+                    && c.size > 0 && c.threads > 0 && c.mc > 0 && c.kc > 0 && c.nc > 0;
+            c.engine = ENGINES;
+            for (int e = 0; e < ENGINES; ++e) {
+                if (strcmp(name, engineNames[e]) == 0) {
+                    c.engine = e;
+                }
+            }
+            valid = valid && c.engine != ENGINES;
+            configs.push_back(c);
+        }
+        fclose(in);
+        if (!valid || configs.empty()) {
+            return false;
+        }
+        table() = configs;
+        return true;
+    }
+
+    // entry for an m x k times k x n product, nearest size in log scale
+    Config select(const int m, const int k, const int n) {
+        const std::vector<Config> &configs = table();
+        if (configs.empty() || (long long) m * k * n <= 0) {
+            return configs.empty() ? defaultConfig() : configs[0];
+        }
+        const double size = cbrt((double) m * k * n);
+        size_t best = 0;
+        for (size_t i = 1; i < configs.size(); ++i) {
+            if (fabs(log(size / configs[i].size)) < fabs(log(size / configs[best].size))) {
+                best = i;
+            }
+        }
+        return configs[best];
+    }
+
+    // pinning of the shared task pool, false before it is built
+    static bool poolPinned() {
+        return scheduler::sharedPool != NULL && scheduler::pool().pinsWorkers();
+    }
+
+    // sets the globals of config; rebuilds the task pool only when its size changes
+    void apply(const Config &config) {
+        kernel::MC = config.mc;
+        kernel::KC = config.kc;
+        kernel::NC = config.nc;
+        recursive::cutoff = recursiveInPlace::cutoff = config.cutoff;
+        recursive::grain = recursiveInPlace::grain = config.grain;
+        strassen::cutoff = config.cutoff;
+        if (config.threads > 1) {
+            omp_set_num_threads(config.threads);
+            if (scheduler::pool().size() != config.threads) {
+                scheduler::setThreads(config.threads, poolPinned());
+            }
+        }
+    }
+
+    /* Every global apply() touches, taken on construction and put back on
+    *   destruction: OpenMP thread count, task pool (size and pinning), kernel
+    *   blocking, cutoffs and grains
+    */
+    class Saved {
+    public:
+        Saved() : mc(kernel::MC), kc(kernel::KC), nc(kernel::NC), threads(omp_get_max_threads()),
+                  // the pool is built on first use with OMP_NUM_THREADS workers
+                  poolThreads(scheduler::sharedPool != NULL ? scheduler::pool().size() : threads),
+                  pinned(poolPinned()) {
+            cutoffs[0] = recursive::cutoff;
+            cutoffs[1] = recursiveInPlace::cutoff;
+            cutoffs[2] = strassen::cutoff;
+            grains[0] = recursive::grain;
+            grains[1] = recursiveInPlace::grain;
+        }
+
+        ~Saved() {
+            kernel::MC = mc;
+            kernel::KC = kc;
+            kernel::NC = nc;
+            recursive::cutoff = cutoffs[0];
+            recursiveInPlace::cutoff = cutoffs[1];
+            strassen::cutoff = cutoffs[2];
+            recursive::grain = grains[0];
+            recursiveInPlace::grain = grains[1];
+            if (omp_get_max_threads() != threads) {
+                omp_set_num_threads(threads);
+            }
+            if (scheduler::sharedPool != NULL
+                    && (scheduler::pool().size() != poolThreads || poolPinned() != pinned)) {
+                scheduler::setThreads(poolThreads, pinned);
+            }
+        }
+
+        Saved(const Saved &) = delete;
+        Saved &operator=(const Saved &) = delete;
+
+    private:
+        const int mc, kc, nc, threads, poolThreads;
+        const bool pinned;
+        int cutoffs[3];
+        int grains[2];
+    };
+
+    template <typename T>
+    void numaOrInPlace(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        recursiveInPlace::multiplyParallel(result, first, second);
+    }
+
+    void numaOrInPlace(Matrix &result, const Matrix &first, const Matrix &second) {
+        numa::multiply(result, first, second);
+    }
+
+    template <typename T>
+    void run(const Config &config, BasicMatrix<T> &result, const BasicMatrix<T> &first,
+            const BasicMatrix<T> &second) {
+        const bool parallel = config.threads > 1;
+        switch (config.engine) {
+            case WINOGRAD:
+                if (parallel) {
+                    winograd::multiplyVectorizedParallel(result, first, second);
+                } else {
+                    winograd::multiplyVectorized(result, first, second);
+                }
+                break;
+            case RECURSIVE:
+                if (parallel) {
+                    recursive::multiplyParallel(result, first, second);
+                } else {
+                    recursive::multiplySerial(result, first, second);
+                }
+                break;
+            case RECURSIVE_IN_PLACE:
+                if (parallel) {
+                    recursiveInPlace::multiplyParallel(result, first, second);
+                } else {
+                    recursiveInPlace::multiplySerial(result, first, second);
+                }
+                break;
+            case STRASSEN:
+                strassen::multiplySerial(result, first, second);
+                break;
+            case NUMA:
+                numaOrInPlace(result, first, second);
+                break;
+            default:
+                kernel::multiply(result, first, second);
+                break;
+        }
+    }
+
+    // result (m x n) = first (m x k) * second (k x n) with the tuned configuration;
+    // the caller's thread count, pool and engine parameters are back afterwards
+    template <typename T>
+    void multiply(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        const Config config = select(result.rows, first.cols, result.cols);
+        const Saved saved;
+        apply(config);
+        run(config, result, first, second);
+    }
+
+    template <typename T>
+    void multiply(T **result, T **first, T **second, const int size) {
+        BasicMatrix<T> a(size, size), b(size, size), c(size, size);
+        a.copyFrom(first);
+        b.copyFrom(second);
+        multiply(c, a, b);
+        c.copyTo(result);
+    }
+
+    // median seconds of config on first * second; negative if the result is off
+    static double measure(const Config &config, const Matrix &first, const Matrix &second,
+            const Matrix &reference, const Options &options) {
+        Matrix result(reference.rows, reference.cols);
+        apply(config);
+        std::vector<double> times;
+        for (int r = 0; r <= options.repeats; ++r) {
+            const double start = omp_get_wtime();
+            run(config, result, first, second);
+            // the first call warms caches, pools and pack buffers
+            if (r > 0) {
+                times.push_back(omp_get_wtime() - start);
+            }
+        }
+        const double seconds = benchmark::median(times);
+        const bool correct = benchmark::relativeError(result, reference) <= options.tolerance;
+        if (options.log != NULL) {
+            fprintf(options.log, "%d %s threads=%d cutoff=%d grain=%d mc=%d kc=%d nc=%d %.3es%s\n",
+                    reference.rows, engineNames[config.engine], config.threads, config.cutoff, config.grain,
+                    config.mc, config.kc, config.nc, seconds, correct ? "" : " wrong result");
+        }
+        return correct ? seconds : -1;
+    }
+
+    static void consider(Config candidate, Config &best, const Matrix &first, const Matrix &second,
+            const Matrix &reference, const Options &options) {
+        candidate.seconds = measure(candidate, first, second, reference, options);
+        if (candidate.seconds >= 0 && (best.seconds < 0 || candidate.seconds < best.seconds)) {
+            best = candidate;
+        }
+    }
+
+    std::vector<Config> tune(const Options &options) {
+        const Saved saved;
+        std::vector<Config> configs;
+        for (size_t s = 0; s < options.sizes.size(); ++s) {
+            const int size = options.sizes[s];
+            benchmark::Random random(options.seed + size);
+            Matrix first(size, size), second(size, size), reference(size, size);
+            benchmark::fillRandom(first, random);
+            benchmark::fillRandom(second, random);
+            kernel::multiply(reference, first, second);
+
+            Config base = defaultConfig();
+            base.size = size;
+            base.seconds = -1;
+            Config best = base;
+
+            // kernel blocking first, every engine below ends in the kernel
+            for (size_t i = 0; i < sizeof(kernelMc) / sizeof(kernelMc[0]); ++i) {
+                for (size_t j = 0; j < sizeof(kernelKc) / sizeof(kernelKc[0]); ++j) {
+                    Config c = base;
+                    c.mc = kernelMc[i];
+                    c.kc = kernelKc[j];
+                    consider(c, best, first, second, reference, options);
+                }
+            }
+            base.mc = best.mc;
+            base.kc = best.kc;
+
+            for (size_t i = 0; i < sizeof(strassenCutoffs) / sizeof(strassenCutoffs[0]); ++i) {
+                Config c = base;
+                c.engine = STRASSEN;
+                c.cutoff = strassenCutoffs[i];
+                if (c.cutoff < size) {
+                    consider(c, best, first, second, reference, options);
+                }
+            }
+
+            for (size_t t = 0; t < options.threads.size(); ++t) {
+                const int threads = options.threads[t];
+                Config c = base;
+                c.threads = threads;
+                c.engine = WINOGRAD;
+                consider(c, best, first, second, reference, options);
+                if (threads > 1) {
+                    c.engine = NUMA;
+                    consider(c, best, first, second, reference, options);
+                }
+
+                for (int engine = RECURSIVE; engine <= RECURSIVE_IN_PLACE; ++engine) {
+                    for (size_t i = 0; i < sizeof(recursionCutoffs) / sizeof(recursionCutoffs[0]); ++i) {
+                        if (recursionCutoffs[i] >= size) {
+                            continue;
+                        }
+                        // the grain only matters to the parallel variant
+                        const size_t grains = threads > 1 ? sizeof(recursionGrains) / sizeof(recursionGrains[0]) : 1;
+                        for (size_t g = 0; g < grains; ++g) {
+                            c.engine = engine;
+                            c.cutoff = recursionCutoffs[i];
+                            c.grain = threads > 1 ? recursionGrains[g] : base.grain;
+                            if (threads <= 1 || c.grain >= c.cutoff) {
+                                consider(c, best, first, second, reference, options);
+                            }
+                        }
+                    }
+                }
+            }
+            configs.push_back(best);
+        }
+        return configs;
+    }
+
+    // tunes, saves to path and makes the result the active table
+    bool tuneAndSave(const char *path, const Options &options = Options()) {
+        const std::vector<Config> configs = tune(options);
+        table() = configs;
+        return save(path, configs);
+    }
+}
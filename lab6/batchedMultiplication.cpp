@@ -0,0 +1,145 @@
+#include <stddef.h>
+#include "matrix.h"
+#include "gemmKernel.h"
+
+/* Batched multiplication of many independent small products
+*       C[b] = A[b] * B[b]      (m x k) * (k x n), b < batch
+*   The batch, not the product, is split across threads: one product is too
+*   small to keep several cores busy, but thousands of them are not.
+*   Sizes up to SMALL_MAX use a row kernel (i, k, j order, one row of C in an
+*   accumulator); for n and k in 8, 16, .., 64 it is instantiated with the
+*   sizes as template arguments, so the compiler unrolls and vectorizes with
+*   fixed trip counts. Larger products go through the blocked kernel, whose
+*   pack buffers are per thread and reused across the whole batch.
+*   Layouts:
+*       strided         A[b] starts at A + b * strideA, rows lda apart
+*       pointer array   A[b] is a pointer of its own, rows lda apart
+*       T**             createMatrix() arrays, rows are contiguous
+*/
+namespace batched {
+    const int SMALL_MAX = 64;
+
+    // K / N of 0: taken from k / n at run time
+    template <typename T, int K, int N>
+    inline void smallKernel(T *C, const int ldc, const T *A, const int lda,
+            const T *B, const int ldb, const int m, const int k, const int n) {
+        const int kk = K > 0 ? K : k;
+        const int nn = N > 0 ? N : n;
+        for (int i = 0; i < m; ++i) {
+            T acc[N > 0 ? N : SMALL_MAX];
+            for (int j = 0; j < nn; ++j) {
+                acc[j] = T();
+            }
+            const T *a = A + (size_t) i * lda;
+            for (int p = 0; p < kk; ++p) {
+                const T x = a[p];
+                const T *b = B + (size_t) p * ldb;
+                for (int j = 0; j < nn; ++j) {
+                    acc[j] += x * b[j];
+                }
+            }
+            T *c = C + (size_t) i * ldc;
+            for (int j = 0; j < nn; ++j) {
+                c[j] = acc[j];
+            }
+        }
+    }
+
+    template <typename T>
+    using ProductKernel = void (*)(T *, const int, const T *, const int,
+            const T *, const int, const int, const int, const int);
+
+    template <typename T>
+    static void largeKernel(T *C, const int ldc, const T *A, const int lda,
+            const T *B, const int ldb, const int m, const int k, const int n) {
+        // views only, the kernel never writes through A or B
+        const BasicMatrix<T> c(C, m, n, ldc), a((T *) A, m, k, lda), b((T *) B, k, n, ldb);
+        kernel::multiply(c, a, b);
+    }
+
+    template <typename T, int N>
+    static ProductKernel<T> selectForColumns(const int k) {
+        switch (k) {
+            case 8: return &smallKernel<T, 8, N>;
+            case 16: return &smallKernel<T, 16, N>;
+            case 24: return &smallKernel<T, 24, N>;
+            case 32: return &smallKernel<T, 32, N>;
+            case 40: return &smallKernel<T, 40, N>;
+            case 48: return &smallKernel<T, 48, N>;
+            case 56: return &smallKernel<T, 56, N>;
+            case 64: return &smallKernel<T, 64, N>;
+            default: return &smallKernel<T, 0, N>;
+        }
+    }
+
+    // picked once per batch, every product of a batch has the same shape
+    template <typename T>
+    ProductKernel<T> selectKernel(const int m, const int k, const int n) {
+        if (m > SMALL_MAX || k > SMALL_MAX || n > SMALL_MAX) {
+            return &largeKernel<T>;
+        }
+        switch (n) {
+            case 8: return selectForColumns<T, 8>(k);
+            case 16: return selectForColumns<T, 16>(k);
+            case 24: return selectForColumns<T, 24>(k);
+            case 32: return selectForColumns<T, 32>(k);
+            case 40: return selectForColumns<T, 40>(k);
+            case 48: return selectForColumns<T, 48>(k);
+            case 56: return selectForColumns<T, 56>(k);
+            case 64: return selectForColumns<T, 64>(k);
+            default: return &smallKernel<T, 0, 0>;
+        }
+    }
+
+    template <typename T>
+    void multiply(T *C, const T *A, const T *B,
+            const int m, const int k, const int n,
+            const int ldc, const int lda, const int ldb,
+            const ptrdiff_t strideC, const ptrdiff_t strideA, const ptrdiff_t strideB,
+            const int batch, const bool parallel = true) {
+        const ProductKernel<T> product = selectKernel<T>(m, k, n);
+        #pragma omp parallel for schedule(static) if(parallel)
+        for (int b = 0; b < batch; ++b) {
+            product(C + b * strideC, ldc, A + b * strideA, lda, B + b * strideB, ldb, m, k, n);
+        }
+    }
+
+    template <typename T>
+    void multiply(T *const *C, const T *const *A, const T *const *B,
+            const int m, const int k, const int n,
+            const int ldc, const int lda, const int ldb,
+            const int batch, const bool parallel = true) {
+        const ProductKernel<T> product = selectKernel<T>(m, k, n);
+        #pragma omp parallel for schedule(static) if(parallel)
+        for (int b = 0; b < batch; ++b) {
+            product(C[b], ldc, A[b], lda, B[b], ldb, m, k, n);
+        }
+    }
+
+    // result[b] = first[b] * second[b], all size x size from createMatrix()
+    template <typename T>
+    void multiply(T ***result, T ***first, T ***second,
+            const int size, const int batch, const bool parallel = true) {
+        const ProductKernel<T> product = selectKernel<T>(size, size, size);
+        #pragma omp parallel for schedule(static) if(parallel)
+        for (int b = 0; b < batch; ++b) {
+            product(result[b][0], size, first[b][0], size, second[b][0], size, size, size, size);
+        }
+    }
+
+    // shapes have to agree across the batch: result[b] is first[0].rows x second[0].cols
+    template <typename T>
+    void multiply(BasicMatrix<T> *result, const BasicMatrix<T> *first, const BasicMatrix<T> *second,
+            const int batch, const bool parallel = true) {
+        if (batch <= 0) {
+            return;
+        }
+        const int m = first[0].rows, k = first[0].cols, n = second[0].cols;
+        const ProductKernel<T> product = selectKernel<T>(m, k, n);
+        #pragma omp parallel for schedule(static) if(parallel)
+        for (int b = 0; b < batch; ++b) {
+            product(result[b].data, result[b].stride, first[b].data, first[b].stride,
+                    second[b].data, second[b].stride, m, k, n);
+        }
+    }
+}
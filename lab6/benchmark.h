@@ -0,0 +1,341 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include "matrix.h"
+#include "utils.h"
+#include "gemmKernel.h"
+#include "scheduler.h"
+#include "perfCounters.h"
+
+/* Benchmark harness for the multiply engines
+*       every (engine, size, threads) case runs `warmup` untimed calls and
+*       `repeats` timed calls on random inputs, reports median / min / stddev
+*       of the wall time and GFLOP/s (2 n^3 / median), and checks the last
+*       result against the blocked classical kernel with a relative tolerance
+*   Inputs come from a fixed-seed generator, so runs are comparable across
+*   builds and hosts.
+*   With PERF_COUNTERS one more, untimed call per case is made under hardware
+*   counters (perfCounters.h): totals for the call, plus per recursion level
+*   for the engines that mark their levels.
+*/
+namespace benchmark {
+    typedef void (*MatrixEngine)(Matrix &, const Matrix &, const Matrix &);
+    typedef void (*ArrayEngine)(double **, double **, double **, const int);
+
+    // exactly one of matrix / array is set
+    struct Engine {
+        std::string name;
+        MatrixEngine matrix;
+        ArrayEngine array;
+        bool parallel;
+        double tolerance;       // 0: Options::tolerance
+
+        Engine(const std::string &name, const MatrixEngine matrix, const ArrayEngine array, const bool parallel,
+                const double tolerance = 0)
+                : name(name), matrix(matrix), array(array), parallel(parallel), tolerance(tolerance) {}
+    };
+
+    struct Options {
+        std::vector<int> sizes;
+        std::vector<int> threads;
+        std::vector<std::string> engines;    // empty: all
+        int warmup;
+        int repeats;
+        uint64_t seed;
+        double tolerance;
+        bool pin;
+        std::string format;                  // csv or json
+
+        Options() : warmup(1), repeats(5), seed(42), tolerance(1e-9), pin(true), format("csv") {}
+    };
+
+    struct Result {
+        std::string engine;
+        int size;
+        int threads;
+        double median;
+        double min;
+        double stddev;
+        double gflops;
+        double relativeError;
+        bool correct;
+#ifdef PERF_COUNTERS
+        perf::Counts counts;
+        std::vector<perf::Level> levels;
+#endif
+    };
+
+    // splitmix64, the same stream on every platform and standard library
+    struct Random {
+        uint64_t state;
+
+        explicit Random(const uint64_t seed) : state(seed) {}
+
+        uint64_t next() {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // uniform in [-1, 1)
+        double uniform() {
+            return (double) (next() >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+        }
+    };
+
+    void fillRandom(const Matrix &matrix, Random &random) {
+        for (int i = 0; i < matrix.rows; ++i) {
+            for (int j = 0; j < matrix.cols; ++j) {
+                matrix[i][j] = random.uniform();
+            }
+        }
+    }
+
+    // max |result - reference| / max |reference|
+    double relativeError(const Matrix &result, const Matrix &reference) {
+        double diff = 0, scale = 0;
+        for (int i = 0; i < reference.rows; ++i) {
+            for (int j = 0; j < reference.cols; ++j) {
+                diff = std::max(diff, fabs(result[i][j] - reference[i][j]));
+                scale = std::max(scale, fabs(reference[i][j]));
+            }
+        }
+        return scale > 0 ? diff / scale : diff;
+    }
+
+    bool selected(const Options &options, const Engine &engine) {
+        if (options.engines.empty()) {
+            return true;
+        }
+        return std::find(options.engines.begin(), options.engines.end(), engine.name) != options.engines.end();
+    }
+
+    void setThreads(const int threads, const bool pin) {
+        omp_set_num_threads(threads);
+        scheduler::setThreads(threads, pin);
+    }
+
+    double median(std::vector<double> times) {
+        std::sort(times.begin(), times.end());
+        const size_t n = times.size();
+        return n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+    }
+
+    double stddev(const std::vector<double> &times) {
+        if (times.size() < 2) {
+            return 0;
+        }
+        double mean = 0;
+        for (size_t i = 0; i < times.size(); ++i) {
+            mean += times[i];
+        }
+        mean /= times.size();
+        double sum = 0;
+        for (size_t i = 0; i < times.size(); ++i) {
+            sum += (times[i] - mean) * (times[i] - mean);
+        }
+        return sqrt(sum / (times.size() - 1));
+    }
+
+    Result measure(const Engine &engine, const Matrix &first, const Matrix &second,
+            const Matrix &reference, const Options &options, const int threads) {
+        const int size = reference.rows;
+        Matrix result(size, size);
+        double **a = NULL, **b = NULL, **c = NULL;
+        if (engine.array != NULL) {
+            a = createMatrix(size, size);
+            b = createMatrix(size, size);
+            c = createMatrix(size, size);
+            first.copyTo(a);
+            second.copyTo(b);
+        }
+
+        std::vector<double> times;
+        for (int run = 0; run < options.warmup + options.repeats; ++run) {
+            if (engine.array != NULL) {
+                // recursiveInPlace accumulates into result
+                kernel::clear(c, 0, 0, size, size);
+            }
+            const double start = omp_get_wtime();
+            if (engine.array != NULL) {
+                engine.array(c, a, b, size);
+            } else {
+                engine.matrix(result, first, second);
+            }
+            const double finish = omp_get_wtime();
+            if (run >= options.warmup) {
+                times.push_back(finish - start);
+            }
+        }
+#ifdef PERF_COUNTERS
+        perf::Counts counts;
+        std::vector<perf::Level> levels;
+        {
+            // after the warmup, so the OpenMP and pool threads exist and get a group
+            perf::ProcessCounters counters;
+            if (engine.array != NULL) {
+                kernel::clear(c, 0, 0, size, size);
+            }
+            perf::resetLevels();
+            counters.start();
+            if (engine.array != NULL) {
+                engine.array(c, a, b, size);
+            } else {
+                engine.matrix(result, first, second);
+            }
+            counts = counters.stop();
+            levels = perf::collectLevels();
+        }
+#endif
+        if (engine.array != NULL) {
+            result.copyFrom(c);
+            freeMatrix(a);
+            freeMatrix(b);
+            freeMatrix(c);
+        }
+
+        Result measured;
+        measured.engine = engine.name;
+        measured.size = size;
+        measured.threads = threads;
+        measured.median = median(times);
+        measured.min = *std::min_element(times.begin(), times.end());
+        measured.stddev = stddev(times);
+        measured.gflops = 2.0 * size * size * size / measured.median * 1e-9;
+        measured.relativeError = relativeError(result, reference);
+        measured.correct = measured.relativeError <= (engine.tolerance > 0 ? engine.tolerance : options.tolerance);
+#ifdef PERF_COUNTERS
+        measured.counts = counts;
+        measured.levels = levels;
+#endif
+        return measured;
+    }
+
+    std::vector<Result> run(const std::vector<Engine> &engines, const Options &options) {
+        std::vector<Result> results;
+        for (size_t s = 0; s < options.sizes.size(); ++s) {
+            const int size = options.sizes[s];
+            Random random(options.seed + size);
+            Matrix first(size, size), second(size, size), reference(size, size);
+            fillRandom(first, random);
+            fillRandom(second, random);
+            kernel::multiply(reference, first, second);
+
+            for (size_t t = 0; t < options.threads.size(); ++t) {
+                const int threads = options.threads[t];
+                setThreads(threads, options.pin);
+                for (size_t e = 0; e < engines.size(); ++e) {
+                    // serial engines only once, at the first thread count
+                    if (!selected(options, engines[e]) || (!engines[e].parallel && t > 0)) {
+                        continue;
+                    }
+                    results.push_back(measure(engines[e], first, second, reference, options, threads));
+                }
+            }
+        }
+        return results;
+    }
+
+#ifdef PERF_COUNTERS
+    // unavailable counters are left empty
+    void writeCountsCsv(FILE *out, const perf::Counts &counts) {
+        for (int e = 0; e < perf::EVENTS; ++e) {
+            if (counts.valid[e]) {
+                fprintf(out, ",%llu", (unsigned long long) counts.value[e]);
+            } else {
+                fprintf(out, ",");
+            }
+        }
+        if (counts.valid[perf::CYCLES] && counts.valid[perf::INSTRUCTIONS] && counts.value[perf::CYCLES] > 0) {
+            fprintf(out, ",%.3f\n", (double) counts.value[perf::INSTRUCTIONS] / counts.value[perf::CYCLES]);
+        } else {
+            fprintf(out, ",\n");
+        }
+    }
+
+    void writeCountsJson(FILE *out, const perf::Counts &counts) {
+        fprintf(out, "{");
+        for (int e = 0; e < perf::EVENTS; ++e) {
+            fprintf(out, "%s\"%s\": ", e > 0 ? ", " : "", perf::eventNames[e]);
+            if (counts.valid[e]) {
+                fprintf(out, "%llu", (unsigned long long) counts.value[e]);
+            } else {
+                fprintf(out, "null");
+            }
+        }
+        fprintf(out, "}");
+    }
+#endif
+
+    void writeCsv(FILE *out, const std::vector<Result> &results) {
+#ifdef PERF_COUNTERS
+        // one row per call (level "all") followed by one per recursion level
+        fprintf(out, "engine,size,threads,level,calls,median_s,min_s,stddev_s,gflops,relative_error,correct");
+        for (int e = 0; e < perf::EVENTS; ++e) {
+            fprintf(out, ",%s", perf::eventNames[e]);
+        }
+        fprintf(out, ",ipc\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &r = results[i];
+            fprintf(out, "%s,%d,%d,all,1,%.6e,%.6e,%.6e,%.3f,%.3e,%d", r.engine.c_str(), r.size, r.threads,
+                    r.median, r.min, r.stddev, r.gflops, r.relativeError, r.correct ? 1 : 0);
+            writeCountsCsv(out, r.counts);
+            for (size_t l = 0; l < r.levels.size(); ++l) {
+                fprintf(out, "%s,%d,%d,%d,%llu,,,,,,", r.engine.c_str(), r.size, r.threads, (int) l,
+                        (unsigned long long) r.levels[l].calls);
+                writeCountsCsv(out, r.levels[l].counts);
+            }
+        }
+#else
+        fprintf(out, "engine,size,threads,median_s,min_s,stddev_s,gflops,relative_error,correct\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &r = results[i];
+            fprintf(out, "%s,%d,%d,%.6e,%.6e,%.6e,%.3f,%.3e,%d\n", r.engine.c_str(), r.size, r.threads,
+                    r.median, r.min, r.stddev, r.gflops, r.relativeError, r.correct ? 1 : 0);
+        }
+#endif
+    }
+
+    void writeJson(FILE *out, const std::vector<Result> &results) {
+        fprintf(out, "[\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &r = results[i];
+            fprintf(out, "  {\"engine\": \"%s\", \"size\": %d, \"threads\": %d, \"median_s\": %.6e, "
+                    "\"min_s\": %.6e, \"stddev_s\": %.6e, \"gflops\": %.3f, \"relative_error\": %.3e, "
+                    "\"correct\": %s", r.engine.c_str(), r.size, r.threads, r.median, r.min, r.stddev,
+                    r.gflops, r.relativeError, r.correct ? "true" : "false");
+#ifdef PERF_COUNTERS
+            fprintf(out, ", \"counters\": ");
+            writeCountsJson(out, r.counts);
+            fprintf(out, ", \"levels\": [");
+            for (size_t l = 0; l < r.levels.size(); ++l) {
+                fprintf(out, "%s{\"level\": %d, \"calls\": %llu, \"counters\": ", l > 0 ? ", " : "",
+                        (int) l, (unsigned long long) r.levels[l].calls);
+                writeCountsJson(out, r.levels[l].counts);
+                fprintf(out, "}");
+            }
+            fprintf(out, "]");
+#endif
+            fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+        }
+        fprintf(out, "]\n");
+    }
+
+    void write(FILE *out, const std::vector<Result> &results, const Options &options) {
+        if (options.format == "json") {
+            writeJson(out, results);
+        } else {
+            writeCsv(out, results);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,441 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "matrix.h"
+#include "gemmKernel.h"
+#include "scheduler.h"
+
+/* van de Geijn, Watts. SUMMA: Scalable Universal Matrix Multiplication Algorithm.
+* Distributed multiplication on a Grid of processes (rows x cols)
+*       process (r, c) holds block (r, c) of first, second and result, the
+*       rows and columns of every matrix cut as evenly as possible (offset())
+*       for every panel of the inner dimension:
+*           the owner of A(r, panel) broadcasts it along process row r
+*           the owner of B(panel, c) broadcasts it down process column c
+*           every process adds Apanel * Bpanel to its block (blocked kernel)
+*   Unlike Cannon's algorithm any grid and any shapes work, there is no
+*   initial skew and a process only ever holds its blocks plus two panels.
+*   Broadcasts are binomial trees of point-to-point messages on a Transport.
+*   A communication thread receives the panels of step s + 1 while the kernel
+*   multiplies step s, so with enough work per panel the transfers are hidden.
+*       Transport           what a backend implements: blocking send/receive
+*                           of bytes between ranks (MPI, TCP on a cluster)
+*       SocketTransport     Unix socket pairs between processes of one host
+*   multiplyLocal() runs it all on one host: rank 0 is the caller, the other ranks
+*   are forked. They read their blocks straight from the inherited (copy on
+*   write) first and second and write theirs into a shared mapping of result,
+*   so only the panels go through the sockets. The forked ranks run serial
+*   code only: OpenMP and the work-stealing pool do not survive fork(). A
+*   caller pinned to one cpu would hand that mask to every rank, so each rank
+*   first widens its own to all cpus of the process's cpuset.
+*/
+namespace distributed {
+    // ranks of multiply(), parent included
+    int processes = 4;
+    // width of a broadcast panel of the inner dimension
+    int panel = 256;
+
+    /* Point-to-point messages between ranks 0 .. size() - 1
+    *   Both calls block until all bytes are out / in and return false (errno
+    *   set) if the peer is gone. Messages between two ranks arrive in the
+    *   order they were sent, there are no tags: both sides follow the same
+    *   schedule. The calls may come from any one thread at a time.
+    */
+    class Transport {
+    public:
+        virtual ~Transport() {}
+        virtual int rank() const = 0;
+        virtual int size() const = 0;
+        virtual bool send(const int to, const void *data, const size_t bytes) = 0;
+        virtual bool receive(const int from, void *data, const size_t bytes) = 0;
+    };
+
+    /* Transport between processes of one host
+    *       one Unix stream socket pair per pair of ranks, created before
+    *       fork(), after which every process calls attach(rank) to keep only
+    *       its own ends
+    */
+    class SocketTransport : public Transport {
+    public:
+        explicit SocketTransport(const int size) : me(-1), count(size), sockets((size_t) size * size, -1) {
+            for (int a = 0; a < size; ++a) {
+                for (int b = a + 1; b < size; ++b) {
+                    int pair[2];
+                    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+                        return;
+                    }
+                    sockets[a * size + b] = pair[0];
+                    sockets[b * size + a] = pair[1];
+                }
+            }
+        }
+
+        ~SocketTransport() {
+            for (size_t s = 0; s < sockets.size(); ++s) {
+                if (sockets[s] >= 0) {
+                    close(sockets[s]);
+                }
+            }
+        }
+
+        SocketTransport(const SocketTransport &) = delete;
+        SocketTransport &operator=(const SocketTransport &) = delete;
+
+        // false if a socket pair could not be created
+        bool valid() const {
+            for (int a = 0; a < count; ++a) {
+                for (int b = 0; b < count; ++b) {
+                    if (a != b && sockets[a * count + b] < 0) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        // drop the ends of the other ranks, a peer sees end of file once its rank exits
+        void attach(const int rank) {
+            me = rank;
+            for (int a = 0; a < count; ++a) {
+                for (int b = 0; b < count; ++b) {
+                    if (a != rank && sockets[a * count + b] >= 0) {
+                        close(sockets[a * count + b]);
+                        sockets[a * count + b] = -1;
+                    }
+                }
+            }
+        }
+
+        int rank() const {
+            return me;
+        }
+
+        int size() const {
+            return count;
+        }
+
+        bool send(const int to, const void *data, const size_t bytes) {
+            const char *p = (const char *) data;
+            for (size_t done = 0; done < bytes; ) {
+                const ssize_t sent = ::send(sockets[me * count + to], p + done, bytes - done, MSG_NOSIGNAL);
+                if (sent < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (sent <= 0) {
+                    return false;
+                }
+                done += sent;
+            }
+            return true;
+        }
+
+        bool receive(const int from, void *data, const size_t bytes) {
+            char *p = (char *) data;
+            for (size_t done = 0; done < bytes; ) {
+                const ssize_t got = recv(sockets[me * count + from], p + done, bytes - done, MSG_WAITALL);
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    if (got == 0) {
+                        errno = ECONNRESET;
+                    }
+                    return false;
+                }
+                done += got;
+            }
+            return true;
+        }
+
+    private:
+        int me;
+        int count;
+        std::vector<int> sockets;       // sockets[a * count + b]: end of rank a towards b
+    };
+
+    struct Grid {
+        int rows;
+        int cols;
+    };
+
+    // rows <= cols, as square as processes allows
+    Grid grid(const int processes) {
+        Grid g = {1, processes > 0 ? processes : 1};
+        for (int rows = 1; rows * rows <= processes; ++rows) {
+            if (processes % rows == 0) {
+                g.rows = rows;
+                g.cols = processes / rows;
+            }
+        }
+        return g;
+    }
+
+    // first index of part `index` of extent cut into `parts`, offset(extent, parts, parts) == extent
+    int offset(const int extent, const int parts, const int index) {
+        return (int) ((int64_t) extent * index / parts);
+    }
+
+    // part of extent cut into `parts` that holds index
+    int owner(const int extent, const int parts, const int index) {
+        int part = (int) ((int64_t) index * parts / (extent > 0 ? extent : 1));
+        while (part + 1 < parts && offset(extent, parts, part + 1) <= index) {
+            ++part;
+        }
+        while (part > 0 && offset(extent, parts, part) > index) {
+            --part;
+        }
+        return part;
+    }
+
+    /* Binomial tree broadcast from member root of the group
+    *       first, first + step, .., first + (members - 1) * step
+    *   Every member receives once from its parent, then sends to its
+    *   children, furthest first (van de Geijn, MPICH).
+    */
+    bool broadcast(Transport &transport, const int first, const int step, const int members, const int root,
+            void *data, const size_t bytes) {
+        if (members < 2 || bytes == 0) {
+            return true;
+        }
+        const int relative = ((transport.rank() - first) / step - root + members) % members;
+        int mask = 1;
+        for (; mask < members; mask <<= 1) {
+            if (relative & mask) {
+                const int parent = (relative - mask + root) % members;
+                if (!transport.receive(first + parent * step, data, bytes)) {
+                    return false;
+                }
+                break;
+            }
+        }
+        for (mask >>= 1; mask > 0; mask >>= 1) {
+            if (relative + mask < members) {
+                const int child = (relative + mask + root) % members;
+                if (!transport.send(first + child * step, data, bytes)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // inner dimension [begin, end) broadcast by process column ownerCol and process row ownerRow
+    struct Step {
+        int begin;
+        int end;
+        int ownerCol;
+        int ownerRow;
+    };
+
+    // panels never straddle a block boundary of first's columns or second's rows
+    std::vector<Step> steps(const Grid g, const int k) {
+        std::vector<Step> list;
+        const int width = panel > 0 ? panel : 1;
+        for (int begin = 0; begin < k; ) {
+            Step s;
+            s.begin = begin;
+            s.ownerCol = owner(k, g.cols, begin);
+            s.ownerRow = owner(k, g.rows, begin);
+            s.end = std::min(std::min(offset(k, g.cols, s.ownerCol + 1), offset(k, g.rows, s.ownerRow + 1)),
+                    begin + width);
+            list.push_back(s);
+            begin = s.end;
+        }
+        return list;
+    }
+
+    // panels of one step: rows x w of first, w x cols of second, both contiguous
+    template <typename T>
+    struct Panels {
+        T *left;
+        T *right;
+    };
+
+    /* SUMMA on this rank
+    *       m x k first times k x n second, the rank at (r, c) of the grid
+    *       (rank = r * g.cols + c) passes its blocks:
+    *           first   rows offset(m, g.rows, r) .., cols offset(k, g.cols, c) ..
+    *           second  rows offset(k, g.rows, r) .., cols offset(n, g.cols, c) ..
+    *           result  rows offset(m, g.rows, r) .., cols offset(n, g.cols, c) ..
+    *   result is overwritten. All ranks of the grid have to call it; false if
+    *   the transport failed (result is then incomplete).
+    */
+    template <typename T>
+    bool summa(Transport &transport, const Grid g, const int k,
+            const BasicMatrix<T> &first, const BasicMatrix<T> &second, const BasicMatrix<T> &result) {
+        const int r = transport.rank() / g.cols, c = transport.rank() % g.cols;
+        const int rows = result.rows, cols = result.cols;
+        const int firstCol = offset(k, g.cols, c), secondRow = offset(k, g.rows, r);
+        const std::vector<Step> list = steps(g, k);
+        const int width = panel > 0 ? panel : 1;
+        result.fill(T());
+
+        // two buffers: the thread fills one while the kernel reads the other
+        Panels<T> buffers[2];
+        for (int b = 0; b < 2; ++b) {
+            buffers[b].left = (T *) alignedMalloc(((size_t) rows * width + 1) * sizeof(T));
+            buffers[b].right = (T *) alignedMalloc(((size_t) width * cols + 1) * sizeof(T));
+        }
+        std::mutex lock;
+        std::condition_variable changed;
+        int fetched = 0, computed = 0, error = 0;
+        bool failed = false;
+
+        std::thread communication([&]() {
+            for (int s = 0; s < (int) list.size(); ++s) {
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&]() { return computed >= s - 1 || failed; });
+                    if (failed) {
+                        return;
+                    }
+                }
+                const Step &step = list[s];
+                const int w = step.end - step.begin;
+                const Panels<T> &p = buffers[s % 2];
+                if (c == step.ownerCol) {
+                    for (int i = 0; i < rows; ++i) {
+                        memcpy(p.left + (size_t) i * w, &first[i][step.begin - firstCol], w * sizeof(T));
+                    }
+                }
+                if (r == step.ownerRow) {
+                    for (int i = 0; i < w; ++i) {
+                        memcpy(p.right + (size_t) i * cols, &second[step.begin - secondRow + i][0], cols * sizeof(T));
+                    }
+                }
+                const bool ok = broadcast(transport, r * g.cols, 1, g.cols, step.ownerCol,
+                                          p.left, (size_t) rows * w * sizeof(T))
+                        && broadcast(transport, c, g.cols, g.rows, step.ownerRow,
+                                     p.right, (size_t) w * cols * sizeof(T));
+                const int sendError = errno;
+                std::lock_guard<std::mutex> guard(lock);
+                failed = !ok;
+                error = ok ? 0 : sendError;
+                fetched = s + 1;
+                changed.notify_all();
+                if (!ok) {
+                    return;
+                }
+            }
+        });
+
+        for (int s = 0; s < (int) list.size(); ++s) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return fetched > s || failed; });
+                if (failed) {
+                    break;
+                }
+            }
+            const int w = list[s].end - list[s].begin;
+            const Panels<T> &p = buffers[s % 2];
+            kernel::multiplyAdd(result, BasicMatrix<T>(p.left, rows, w, w), BasicMatrix<T>(p.right, w, cols, cols));
+            std::lock_guard<std::mutex> guard(lock);
+            computed = s + 1;
+            changed.notify_all();
+        }
+        communication.join();
+
+        for (int b = 0; b < 2; ++b) {
+            alignedFree(buffers[b].left);
+            alignedFree(buffers[b].right);
+        }
+        if (failed) {
+            // errno is per thread, hand over the one of the transport call
+            errno = error != 0 ? error : EIO;
+        }
+        return !failed;
+    }
+
+    // this rank's blocks of whole matrices every rank can see
+    template <typename T>
+    static bool summaOnViews(Transport &transport, const Grid g, const BasicMatrix<T> &result,
+            const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        const int m = first.rows, k = first.cols, n = second.cols;
+        const int r = transport.rank() / g.cols, c = transport.rank() % g.cols;
+        const int i0 = offset(m, g.rows, r), i1 = offset(m, g.rows, r + 1);
+        const int j0 = offset(n, g.cols, c), j1 = offset(n, g.cols, c + 1);
+        const int ka = offset(k, g.cols, c), kb = offset(k, g.rows, r);
+        return summa(transport, g, k,
+                     first.view(i0, ka, i1 - i0, offset(k, g.cols, c + 1) - ka),
+                     second.view(kb, j0, offset(k, g.rows, r + 1) - kb, j1 - j0),
+                     result.view(i0, j0, i1 - i0, j1 - j0));
+    }
+
+    /* result = first * second by `ranks` processes of this host
+    *   false if the shapes do not fit (errno = EINVAL), a socket, the shared
+    *   mapping or a process could not be created, or a rank failed (EIO);
+    *   result is then incomplete.
+    */
+    template <typename T>
+    bool multiplyLocal(const BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second,
+            const int ranks) {
+        if (first.cols != second.rows || result.rows != first.rows || result.cols != second.cols || ranks < 1) {
+            errno = EINVAL;
+            return false;
+        }
+        const Grid g = grid(ranks);
+        const size_t bytes = (size_t) result.rows * result.cols * sizeof(T);
+        void *mapped = mmap(NULL, bytes > 0 ? bytes : 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        const BasicMatrix<T> shared((T *) mapped, result.rows, result.cols, result.cols);
+        bool ok;
+        {
+            SocketTransport transport(ranks);
+            ok = transport.valid();
+            std::vector<pid_t> workers;
+            for (int rank = 1; rank < ranks && ok; ++rank) {
+                const pid_t pid = fork();
+                if (pid == 0) {
+                    scheduler::unpinCurrentThread();
+                    transport.attach(rank);
+                    _exit(summaOnViews(transport, g, shared, first, second) ? 0 : 1);
+                }
+                ok = pid > 0;
+                if (ok) {
+                    workers.push_back(pid);
+                }
+            }
+            // if a fork failed the started ranks see their peers vanish and exit
+            transport.attach(0);
+            ok = ok && summaOnViews(transport, g, shared, first, second);
+            if (!ok) {
+                transport.attach(-1);
+            }
+            const int savedErrno = errno;
+            for (size_t w = 0; w < workers.size(); ++w) {
+                int status;
+                while (waitpid(workers[w], &status, 0) < 0 && errno == EINTR) {
+                }
+                ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            }
+            errno = ok ? savedErrno : (savedErrno != 0 ? savedErrno : EIO);
+        }
+        if (ok) {
+            for (int i = 0; i < result.rows; ++i) {
+                memcpy(result[i], shared[i], result.cols * sizeof(T));
+            }
+        }
+        munmap(mapped, bytes > 0 ? bytes : 1);
+        return ok;
+    }
+
+    // with the signature of the other engines: `processes` ranks, the blocked kernel if they can not be started
+    template <typename T>
+    void multiply(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        if (!multiplyLocal(result, first, second, processes)) {
+            kernel::multiply(result, first, second);
+        }
+    }
+}
@@ -0,0 +1,215 @@
+#ifndef GEMM_KERNEL_H
+#define GEMM_KERNEL_H
+
+#include <stdlib.h>
+#include "matrix.h"
+
+/* Goto, van de Geijn. Anatomy of High-Performance Matrix Multiplication.
+* Cache blocked classical kernel
+*       C[iC.., jC..] += A[iA.., jA..] * B[iB.., jB..]      (m x k) * (k x n)
+*   B is packed into KC x NC panels (L2/L3), A into MC x KC panels (L1/L2),
+*   both cut into MR / NR wide slivers so that the micro-kernel streams
+*   through memory with unit stride and keeps an MR x NR tile of C in registers.
+*   Works on anything indexable as m[i][j] (T** or BasicMatrix<T>), the
+*   register tile is picked per element type (Tile<T>).
+*/
+namespace kernel {
+    // register tile per element type: NR is two (four for 32 bit types)
+    // SIMD vectors of the widest common vector width, MR rows of it
+    template <typename T>
+    struct Tile {
+        static const int MR = 4;
+        static const int NR = 8;
+    };
+
+    template <>
+    struct Tile<float> {
+        static const int MR = 4;
+        static const int NR = 16;
+    };
+
+    template <>
+    struct Tile<int32_t> {
+        static const int MR = 4;
+        static const int NR = 16;
+    };
+
+    template <>
+    struct Tile<std::complex<float> > {
+        static const int MR = 2;
+        static const int NR = 8;
+    };
+
+    template <>
+    struct Tile<std::complex<double> > {
+        static const int MR = 2;
+        static const int NR = 4;
+    };
+
+    // tile of the double kernel
+    const int MR = Tile<double>::MR;
+    const int NR = Tile<double>::NR;
+
+    // blocking parameters, tune to the cache sizes of the host
+    int MC = 128;
+    int KC = 256;
+    int NC = 2048;
+
+    template <typename T>
+    static T *packBuffer(T *&buffer, size_t &capacity, const size_t elements) {
+        if (capacity < elements) {
+            alignedFree(buffer);
+            buffer = (T *) alignedMalloc(elements * sizeof(T));
+            capacity = elements;
+        }
+        return buffer;
+    }
+
+    // every thread packs into its own buffers, they live as long as the thread
+    template <typename T>
+    static T *packedA(const size_t elements) {
+        static thread_local T *buffer = NULL;
+        static thread_local size_t capacity = 0;
+        return packBuffer(buffer, capacity, elements);
+    }
+
+    template <typename T>
+    static T *packedB(const size_t elements) {
+        static thread_local T *buffer = NULL;
+        static thread_local size_t capacity = 0;
+        return packBuffer(buffer, capacity, elements);
+    }
+
+    // mc x kc block of A -> row slivers of MR rows, sliver stored column by column
+    template <typename T, typename TA>
+    void packA(T *packed, const TA &A, const int iA, const int jA, const int mc, const int kc) {
+        const int MR = Tile<T>::MR;
+        for (int ir = 0; ir < mc; ir += MR) {
+            const int rows = mc - ir < MR ? mc - ir : MR;
+            for (int i = 0; i < MR; ++i) {
+                if (i < rows) {
+                    const T *row = &A[iA + ir + i][jA];
+                    for (int p = 0; p < kc; ++p) {
+                        packed[p * MR + i] = row[p];
+                    }
+                } else {
+                    for (int p = 0; p < kc; ++p) {
+                        packed[p * MR + i] = T();
+                    }
+                }
+            }
+            packed += kc * MR;
+        }
+    }
+
+    // kc x nc block of B -> column slivers of NR columns, sliver stored row by row
+    template <typename T, typename TB>
+    void packB(T *packed, const TB &B, const int iB, const int jB, const int kc, const int nc) {
+        const int NR = Tile<T>::NR;
+        for (int jr = 0; jr < nc; jr += NR) {
+            const int cols = nc - jr < NR ? nc - jr : NR;
+            for (int p = 0; p < kc; ++p) {
+                const T *row = &B[iB + p][jB + jr];
+                int j = 0;
+                for (; j < cols; ++j) {
+                    packed[j] = row[j];
+                }
+                for (; j < NR; ++j) {
+                    packed[j] = T();
+                }
+                packed += NR;
+            }
+        }
+    }
+
+    // MR x NR tile: tile = a * b over kc, a and b are packed slivers
+    template <typename T>
+    inline void microKernel(const int kc, const T *a, const T *b, T tile[Tile<T>::MR][Tile<T>::NR]) {
+        const int MR = Tile<T>::MR, NR = Tile<T>::NR;
+        T acc[Tile<T>::MR][Tile<T>::NR] = {};
+        for (int p = 0; p < kc; ++p) {
+            for (int i = 0; i < MR; ++i) {
+                const T ai = a[i];
+                for (int j = 0; j < NR; ++j) {
+                    acc[i][j] += ai * b[j];
+                }
+            }
+            a += MR;
+            b += NR;
+        }
+        for (int i = 0; i < MR; ++i) {
+            for (int j = 0; j < NR; ++j) {
+                tile[i][j] = acc[i][j];
+            }
+        }
+    }
+
+    template <typename TC, typename TA, typename TB>
+    void multiplyAdd(const TC &C, const int iC, const int jC,
+            const TA &A, const int iA, const int jA,
+            const TB &B, const int iB, const int jB,
+            const int m, const int n, const int k) {
+        typedef typename ElementOf<TC>::type T;
+        const int MR = Tile<T>::MR, NR = Tile<T>::NR;
+        if (m <= 0 || n <= 0 || k <= 0) {
+            return;
+        }
+        const int kcMax = k < KC ? k : KC;
+        const int ncMax = n < NC ? n : NC;
+        const int mcMax = m < MC ? m : MC;
+        T *bPanel = packedB<T>((size_t) kcMax * ((ncMax + NR - 1) / NR * NR));
+        T *aPanel = packedA<T>((size_t) kcMax * ((mcMax + MR - 1) / MR * MR));
+        T tile[Tile<T>::MR][Tile<T>::NR];
+
+        for (int jc = 0; jc < n; jc += NC) {
+            const int nc = n - jc < NC ? n - jc : NC;
+            for (int pc = 0; pc < k; pc += KC) {
+                const int kc = k - pc < KC ? k - pc : KC;
+                packB(bPanel, B, iB + pc, jB + jc, kc, nc);
+                for (int ic = 0; ic < m; ic += MC) {
+                    const int mc = m - ic < MC ? m - ic : MC;
+                    packA(aPanel, A, iA + ic, jA + pc, mc, kc);
+                    for (int jr = 0; jr < nc; jr += NR) {
+                        const int cols = nc - jr < NR ? nc - jr : NR;
+                        for (int ir = 0; ir < mc; ir += MR) {
+                            const int rows = mc - ir < MR ? mc - ir : MR;
+                            microKernel(kc, aPanel + ir * kc, bPanel + jr * kc, tile);
+                            for (int i = 0; i < rows; ++i) {
+                                T *out = &C[iC + ic + ir + i][jC + jc + jr];
+                                for (int j = 0; j < cols; ++j) {
+                                    out[j] += tile[i][j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    template <typename TC>
+    void clear(const TC &C, const int iC, const int jC, const int m, const int n) {
+        typedef typename ElementOf<TC>::type T;
+        for (int i = 0; i < m; ++i) {
+            T *out = &C[iC + i][jC];
+            for (int j = 0; j < n; ++j) {
+                out[j] = T();
+            }
+        }
+    }
+
+    // C = A * B
+    template <typename T>
+    void multiply(const BasicMatrix<T> &C, const BasicMatrix<T> &A, const BasicMatrix<T> &B) {
+        C.fill(T());
+        multiplyAdd(C, 0, 0, A, 0, 0, B, 0, 0, C.rows, C.cols, A.cols);
+    }
+
+    // C += A * B
+    template <typename T>
+    void multiplyAdd(const BasicMatrix<T> &C, const BasicMatrix<T> &A, const BasicMatrix<T> &B) {
+        multiplyAdd(C, 0, 0, A, 0, 0, B, 0, 0, C.rows, C.cols, A.cols);
+    }
+}
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <complex>
+#include <type_traits>
+#include <utility>
+
+#define MATRIX_ALIGNMENT 64
+
+void *alignedMalloc(const size_t bytes) {
+    // keep the original pointer just in front of the aligned block
+    void *raw = malloc(bytes + MATRIX_ALIGNMENT + sizeof(void *));
+    if (raw == NULL) {
+        return NULL;
+    }
+    uintptr_t start = (uintptr_t) raw + sizeof(void *);
+    uintptr_t aligned = (start + MATRIX_ALIGNMENT - 1) & ~(uintptr_t) (MATRIX_ALIGNMENT - 1);
+    ((void **) aligned)[-1] = raw;
+    return (void *) aligned;
+}
+
+void alignedFree(void *block) {
+    if (block != NULL) {
+        free(((void **) block)[-1]);
+    }
+}
+
+/* Dense row-major matrix of T stored in one contiguous aligned buffer
+*       element (i, j) lives at data[i * stride + j]
+*       stride (leading dimension) is rounded up so that every row starts on a
+*       MATRIX_ALIGNMENT boundary
+*   An owning Matrix frees its buffer in the destructor, a view (see view())
+*   only points into the buffer of another matrix and must not outlive it.
+*   Constness is shallow, like for double**: a const Matrix can not be
+*   re-pointed, but its elements can still be written through m[i][j].
+*   T is any type with + - * and T() as zero: float, double, int32_t,
+*   int64_t, std::complex; Matrix is the double one all engines default to.
+*/
+template <typename T>
+class BasicMatrix {
+public:
+    T *data;
+    int rows;
+    int cols;
+    int stride;
+
+    BasicMatrix() : data(NULL), rows(0), cols(0), stride(0), owner(false) {}
+
+    BasicMatrix(const int rows, const int cols)
+            : rows(rows), cols(cols), stride(paddedStride(cols)), owner(true) {
+        data = (T *) alignedMalloc((size_t) rows * stride * sizeof(T));
+    }
+
+    BasicMatrix(T *data, const int rows, const int cols, const int stride)
+            : data(data), rows(rows), cols(cols), stride(stride), owner(false) {}
+
+    BasicMatrix(BasicMatrix &&other)
+            : data(other.data), rows(other.rows), cols(other.cols), stride(other.stride), owner(other.owner) {
+        other.data = NULL;
+        other.owner = false;
+    }
+
+    BasicMatrix &operator=(BasicMatrix &&other) {
+        if (this != &other) {
+            release();
+            data = other.data;
+            rows = other.rows;
+            cols = other.cols;
+            stride = other.stride;
+            owner = other.owner;
+            other.data = NULL;
+            other.owner = false;
+        }
+        return *this;
+    }
+
+    BasicMatrix(const BasicMatrix &) = delete;
+    BasicMatrix &operator=(const BasicMatrix &) = delete;
+
+    ~BasicMatrix() {
+        release();
+    }
+
+    T *operator[](const int i) const {
+        return data + (size_t) i * stride;
+    }
+
+    // non-owning view of the block [i, i + rows) x [j, j + cols)
+    BasicMatrix view(const int i, const int j, const int rows, const int cols) const {
+        return BasicMatrix(data + (size_t) i * stride + j, rows, cols, stride);
+    }
+
+    bool isView() const {
+        return !owner;
+    }
+
+    void fill(const T value) const {
+        for (int i = 0; i < rows; ++i) {
+            T *row = (*this)[i];
+            for (int j = 0; j < cols; ++j) {
+                row[j] = value;
+            }
+        }
+    }
+
+    void copyFrom(T **src) const {
+        for (int i = 0; i < rows; ++i) {
+            memcpy((*this)[i], src[i], cols * sizeof(T));
+        }
+    }
+
+    void copyTo(T **dst) const {
+        for (int i = 0; i < rows; ++i) {
+            memcpy(dst[i], (*this)[i], cols * sizeof(T));
+        }
+    }
+
+    static int paddedStride(const int cols) {
+        const int perLine = MATRIX_ALIGNMENT / sizeof(T);
+        return (cols + perLine - 1) / perLine * perLine;
+    }
+
+private:
+    bool owner;
+
+    void release() {
+        if (owner) {
+            alignedFree(data);
+        }
+        data = NULL;
+        owner = false;
+    }
+};
+
+typedef BasicMatrix<double> Matrix;
+
+// element type behind anything indexable as m[i][j] (T**, BasicMatrix<T>)
+template <typename M>
+struct ElementOf {
+    typedef typename std::remove_reference<decltype(std::declval<const M &>()[0][0])>::type type;
+};
+
+void printValue(const double value) {
+    printf("%8.2f", value);
+}
+
+void printValue(const float value) {
+    printf("%8.2f", value);
+}
+
+void printValue(const int32_t value) {
+    printf("%8d", value);
+}
+
+void printValue(const int64_t value) {
+    printf("%8lld", (long long) value);
+}
+
+template <typename T>
+void printValue(const std::complex<T> value) {
+    printf(" (%.2f,%.2f)", (double) value.real(), (double) value.imag());
+}
+
+template <typename T>
+void printMatrix(const BasicMatrix<T> &matrix) {
+    for (int i = 0; i < matrix.rows; i++) {
+        for (int j = 0; j < matrix.cols; j++) {
+            printValue(matrix[i][j]);
+        }
+        printf("\n");
+    }
+}
+
+template <typename T>
+bool isCorrect(const BasicMatrix<T> &src, const BasicMatrix<T> &matrix) {
+    if (src.rows != matrix.rows || src.cols != matrix.cols) {
+        return false;
+    }
+    for (int i = 0; i < src.rows; ++i) {
+        for (int j = 0; j < src.cols; ++j) {
+            if (src[i][j] != matrix[i][j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#endif
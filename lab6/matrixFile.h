@@ -0,0 +1,344 @@
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+
+/* On-disk matrix format
+*       64 byte header, then the elements from dataOffset (page aligned) on
+*   Layouts:
+*       LAYOUT_ROW_MAJOR    rows x cols, row after row, no padding
+*       LAYOUT_TILED        tileRows x tileCols tiles, tile after tile in row
+*                           major order of the tile grid, every tile stored
+*                           row-major and full size, edge tiles zero padded
+*   A tile is contiguous on disk, so one tile is one mmap range to prefetch
+*   or drop, and it can be used in place as a Matrix view (stride tileCols).
+*   Integers are stored in host byte order; byteOrder tells a reader on the
+*   other endianness that it can not map the file as is.
+*/
+#define MATRIX_FILE_MAGIC "AIIMATRX"
+
+enum MatrixFileType {
+    DTYPE_FLOAT64 = 1,
+    DTYPE_FLOAT32 = 2,
+    DTYPE_INT32 = 3,
+    DTYPE_INT64 = 4,
+    DTYPE_COMPLEX128 = 5
+};
+
+enum MatrixFileLayout {
+    LAYOUT_ROW_MAJOR = 0,
+    LAYOUT_TILED = 1
+};
+
+struct MatrixFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;         // 0x01020304 as the writer saw it
+    uint32_t dtype;
+    uint32_t layout;
+    uint64_t rows;
+    uint64_t cols;
+    uint32_t tileRows;          // LAYOUT_TILED only
+    uint32_t tileCols;
+    uint64_t dataOffset;
+    uint8_t reserved[8];
+};
+
+const uint32_t MATRIX_FILE_VERSION = 1;
+const uint32_t MATRIX_FILE_BYTE_ORDER = 0x01020304;
+
+// bytes of one element, 0 for an unknown type
+size_t dtypeSize(const uint32_t dtype) {
+    switch (dtype) {
+        case DTYPE_FLOAT64: return 8;
+        case DTYPE_FLOAT32: return 4;
+        case DTYPE_INT32: return 4;
+        case DTYPE_INT64: return 8;
+        case DTYPE_COMPLEX128: return 16;
+        default: return 0;
+    }
+}
+
+// header of a new file, data starts on the first page after it
+MatrixFileHeader matrixFileHeader(const uint32_t dtype, const uint32_t layout, const uint64_t rows, const uint64_t cols,
+        const uint32_t tileRows, const uint32_t tileCols) {
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = MATRIX_FILE_VERSION;
+    header.byteOrder = MATRIX_FILE_BYTE_ORDER;
+    header.dtype = dtype;
+    header.layout = layout;
+    header.rows = rows;
+    header.cols = cols;
+    header.tileRows = layout == LAYOUT_TILED ? tileRows : 0;
+    header.tileCols = layout == LAYOUT_TILED ? tileCols : 0;
+    header.dataOffset = (uint64_t) sysconf(_SC_PAGESIZE);
+    return header;
+}
+
+// false (errno = EINVAL) if the header is not one this build can map
+bool validHeader(const MatrixFileHeader &header) {
+    const bool valid = memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) == 0
+            && header.version == MATRIX_FILE_VERSION
+            && header.byteOrder == MATRIX_FILE_BYTE_ORDER
+            && dtypeSize(header.dtype) > 0
+            && (header.layout == LAYOUT_ROW_MAJOR
+                || (header.layout == LAYOUT_TILED && header.tileRows > 0 && header.tileCols > 0))
+            && header.dataOffset >= sizeof(header);
+    if (!valid) {
+        errno = EINVAL;
+    }
+    return valid;
+}
+
+// bytes of element data behind the header
+uint64_t matrixFileDataBytes(const MatrixFileHeader &header) {
+    if (header.layout == LAYOUT_TILED) {
+        const uint64_t down = (header.rows + header.tileRows - 1) / header.tileRows;
+        const uint64_t across = (header.cols + header.tileCols - 1) / header.tileCols;
+        return down * across * header.tileRows * header.tileCols * dtypeSize(header.dtype);
+    }
+    return header.rows * header.cols * dtypeSize(header.dtype);
+}
+
+/* Matrix of doubles mapped from a file
+*       create() sizes a new file (contents zero), open() maps an existing
+*       one; both return false with errno set on failure
+*   The mapping is shared: writes go to the file, pages are read in on first
+*   access and can be evicted again, so the file may be far larger than RAM.
+*   tile(ti, tj) is a zero-copy view; in LAYOUT_ROW_MAJOR the grid is the
+*   tile size passed to open() (stride cols), in LAYOUT_TILED the stored one.
+*/
+class MappedMatrix {
+public:
+    MatrixFileHeader header;
+
+    MappedMatrix() : base(NULL), length(0), fd(-1), tileRows(0), tileCols(0) {
+        memset(&header, 0, sizeof(header));
+    }
+
+    ~MappedMatrix() {
+        close();
+    }
+
+    MappedMatrix(const MappedMatrix &) = delete;
+    MappedMatrix &operator=(const MappedMatrix &) = delete;
+
+    // tileRows and tileCols both > 0 for LAYOUT_TILED, both <= 0 for LAYOUT_ROW_MAJOR
+    bool create(const char *path, const int rows, const int cols, const int tileRows, const int tileCols) {
+        close();
+        if ((tileRows > 0) != (tileCols > 0)) {
+            errno = EINVAL;
+            return false;
+        }
+        header = matrixFileHeader(DTYPE_FLOAT64, tileRows > 0 ? LAYOUT_TILED : LAYOUT_ROW_MAJOR,
+                rows, cols, tileRows, tileCols);
+        fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        length = header.dataOffset + matrixFileDataBytes(header);
+        if (ftruncate(fd, (off_t) length) != 0 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            close();
+            return false;
+        }
+        return map(true, tileRows, tileCols);
+    }
+
+    // defaultTileRows / defaultTileCols: tile grid for LAYOUT_ROW_MAJOR files
+    bool open(const char *path, const bool writable, const int defaultTileRows = 512, const int defaultTileCols = 512) {
+        close();
+        fd = ::open(path, writable ? O_RDWR : O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat status;
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || !validHeader(header)
+                || fstat(fd, &status) != 0) {
+            close();
+            return false;
+        }
+        if (header.dtype != DTYPE_FLOAT64) {
+            close();
+            errno = ENOTSUP;
+            return false;
+        }
+        length = header.dataOffset + matrixFileDataBytes(header);
+        if ((uint64_t) status.st_size < length) {
+            close();
+            errno = EINVAL;
+            return false;
+        }
+        return map(writable, header.layout == LAYOUT_TILED ? (int) header.tileRows : defaultTileRows,
+                header.layout == LAYOUT_TILED ? (int) header.tileCols : defaultTileCols);
+    }
+
+    void close() {
+        if (base != NULL) {
+            munmap(base, length);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        base = NULL;
+        length = 0;
+        fd = -1;
+    }
+
+    bool isOpen() const {
+        return base != NULL;
+    }
+
+    int rows() const {
+        return (int) header.rows;
+    }
+
+    int cols() const {
+        return (int) header.cols;
+    }
+
+    int tileHeight() const {
+        return tileRows;
+    }
+
+    int tileWidth() const {
+        return tileCols;
+    }
+
+    int tilesDown() const {
+        return (rows() + tileRows - 1) / tileRows;
+    }
+
+    int tilesAcross() const {
+        return (cols() + tileCols - 1) / tileCols;
+    }
+
+    // the stored part of tile (ti, tj), edge tiles are smaller
+    Matrix tile(const int ti, const int tj) const {
+        const int i0 = ti * tileRows, j0 = tj * tileCols;
+        const int h = rows() - i0 < tileRows ? rows() - i0 : tileRows;
+        const int w = cols() - j0 < tileCols ? cols() - j0 : tileCols;
+        if (header.layout == LAYOUT_TILED) {
+            return Matrix(data() + tileOffset(ti, tj), h, w, tileCols);
+        }
+        return Matrix(data() + (size_t) i0 * cols() + j0, h, w, cols());
+    }
+
+    // start reading the tile in the background
+    void prefetch(const int ti, const int tj) const {
+        advise(ti, tj, MADV_WILLNEED);
+    }
+
+    // the tile will not be needed soon, its clean pages may go right away
+    void drop(const int ti, const int tj) const {
+        advise(ti, tj, MADV_DONTNEED);
+    }
+
+    // schedule write back of everything written so far
+    void flush(const bool wait = false) const {
+        if (base != NULL) {
+            msync(base, length, wait ? MS_SYNC : MS_ASYNC);
+        }
+    }
+
+    // the same for the pages of one tile
+    void flush(const int ti, const int tj, const bool wait = false) const {
+        size_t from, to;
+        if (pages(ti, tj, false, from, to)) {
+            msync(base + from, to - from, wait ? MS_SYNC : MS_ASYNC);
+        }
+    }
+
+    void copyFrom(double **source) const {
+        for (int i = 0; i < rows(); ++i) {
+            for (int tj = 0; tj < tilesAcross(); ++tj) {
+                const Matrix t = tile(i / tileRows, tj);
+                memcpy(t[i % tileRows], source[i] + tj * tileCols, t.cols * sizeof(double));
+            }
+        }
+    }
+
+    void copyTo(double **destination) const {
+        for (int i = 0; i < rows(); ++i) {
+            for (int tj = 0; tj < tilesAcross(); ++tj) {
+                const Matrix t = tile(i / tileRows, tj);
+                memcpy(destination[i] + tj * tileCols, t[i % tileRows], t.cols * sizeof(double));
+            }
+        }
+    }
+
+private:
+    char *base;
+    size_t length;
+    int fd;
+    int tileRows;
+    int tileCols;
+
+    bool map(const bool writable, const int rowsPerTile, const int colsPerTile) {
+        tileRows = rowsPerTile > 0 ? rowsPerTile : 1;
+        tileCols = colsPerTile > 0 ? colsPerTile : 1;
+        void *mapped = mmap(NULL, length, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close();
+            return false;
+        }
+        base = (char *) mapped;
+        return true;
+    }
+
+    double *data() const {
+        return (double *) (base + header.dataOffset);
+    }
+
+    // in doubles, LAYOUT_TILED
+    size_t tileOffset(const int ti, const int tj) const {
+        return ((size_t) ti * tilesAcross() + tj) * tileRows * tileCols;
+    }
+
+    // whole pages of the mapping covering the tile, or with inner only those
+    // not shared with a neighbour; row-major tiles are not contiguous, there
+    // the range spans every row the tile touches. false if it is empty
+    bool pages(const int ti, const int tj, const bool inner, size_t &from, size_t &to) const {
+        if (base == NULL) {
+            return false;
+        }
+        if (header.layout == LAYOUT_TILED) {
+            from = header.dataOffset + tileOffset(ti, tj) * sizeof(double);
+            to = from + (size_t) tileRows * tileCols * sizeof(double);
+        } else {
+            const Matrix t = tile(ti, tj);
+            from = (char *) t.data - base;
+            to = (char *) (t[t.rows - 1] + t.cols) - base;
+        }
+        const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        if (inner) {
+            from = (from + page - 1) / page * page;
+            to = to / page * page;
+        } else {
+            from = from / page * page;
+            to = (to + page - 1) / page * page;
+        }
+        if (to > length) {
+            to = length;
+        }
+        return to > from;
+    }
+
+    void advise(const int ti, const int tj, const int advice) const {
+        size_t from, to;
+        // DONTNEED must not hit pages shared with a neighbour tile
+        if (pages(ti, tj, advice == MADV_DONTNEED, from, to)) {
+            madvise(base + from, to - from, advice);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,606 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <complex>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "matrix.h"
+#include "matrixFile.h"
+#include "utils.h"
+
+/* Matrix files
+*       save / load     the binary format of matrixFile.h (LAYOUT_ROW_MAJOR),
+*                       rows go straight between the file and the matrix
+*                       buffer, split across threads
+*       readText        CSV / whitespace separated text, one row per line;
+*                       the file is mapped, cut into chunks at line breaks
+*                       and every chunk parsed by its own thread
+*       writeText       rows are formatted in parallel, a batch at a time,
+*                       and written in order, so memory stays bounded
+*       read / write    pick the format: read by the file's magic, write by
+*                       the extension (.csv .tsv .txt are text)
+*   All return false with errno set on failure: EINVAL for a malformed file
+*   (ragged rows, a token that is not a number), ENOTSUP for an element type
+*   the format has no form for (complex text, complex<float> binary).
+*   Numbers are parsed from_chars style, on [begin, end) with no locale and
+*   no copy, and rounded correctly: a mantissa of up to 19 digits times a
+*   power of ten up to 10^22 is exact in double arithmetic (Clinger's fast
+*   path) when the mantissa fits 53 bits, otherwise for powers up to 10^19
+*   the product or quotient is taken in 128 bit integers and rounded once;
+*   anything else (longer mantissas, larger exponents, inf, nan) goes
+*   through strtod.
+*/
+namespace matrixIO {
+    template <typename T>
+    struct Dtype {
+        static const uint32_t value = 0;
+    };
+
+    template <> struct Dtype<double> { static const uint32_t value = DTYPE_FLOAT64; };
+    template <> struct Dtype<float> { static const uint32_t value = DTYPE_FLOAT32; };
+    template <> struct Dtype<int32_t> { static const uint32_t value = DTYPE_INT32; };
+    template <> struct Dtype<int64_t> { static const uint32_t value = DTYPE_INT64; };
+    template <> struct Dtype<std::complex<double> > { static const uint32_t value = DTYPE_COMPLEX128; };
+
+    // bytes one thread moves at a time in save / load
+    const size_t CHUNK_BYTES = (size_t) 8 << 20;
+    // elements formatted per batch in writeText
+    const size_t WRITE_BATCH = (size_t) 1 << 20;
+
+    // the whole range, retrying short transfers
+    bool transfer(const int fd, char *buffer, size_t bytes, off_t offset, const bool writing) {
+        while (bytes > 0) {
+            const ssize_t done = writing ? pwrite(fd, buffer, bytes, offset) : pread(fd, buffer, bytes, offset);
+            if (done < 0 && errno == EINTR) {
+                continue;
+            }
+            if (done <= 0) {
+                if (done == 0) {
+                    errno = EIO;
+                }
+                return false;
+            }
+            buffer += done;
+            bytes -= (size_t) done;
+            offset += done;
+        }
+        return true;
+    }
+
+    // bytes [0, total) of the file at offset <-> buffer, CHUNK_BYTES per task
+    bool transferParallel(const int fd, char *buffer, const size_t total, const off_t offset,
+            const bool writing) {
+        const long chunks = (long) ((total + CHUNK_BYTES - 1) / CHUNK_BYTES);
+        bool ok = true;
+        #pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+        for (long c = 0; c < chunks; ++c) {
+            const size_t from = (size_t) c * CHUNK_BYTES;
+            const size_t bytes = total - from < CHUNK_BYTES ? total - from : CHUNK_BYTES;
+            ok = transfer(fd, buffer + from, bytes, offset + (off_t) from, writing) && ok;
+        }
+        return ok;
+    }
+
+    template <typename T>
+    bool save(const char *path, const BasicMatrix<T> &matrix) {
+        if (Dtype<T>::value == 0) {
+            errno = ENOTSUP;
+            return false;
+        }
+        const MatrixFileHeader header = matrixFileHeader(Dtype<T>::value, LAYOUT_ROW_MAJOR,
+                matrix.rows, matrix.cols, 0, 0);
+        const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        const size_t rowBytes = (size_t) matrix.cols * sizeof(T);
+        const size_t total = (size_t) matrix.rows * rowBytes;
+        bool ok = ftruncate(fd, (off_t) (header.dataOffset + total)) == 0
+                && transfer(fd, (char *) &header, sizeof(header), 0, true);
+        if (ok && matrix.stride == matrix.cols) {
+            ok = transferParallel(fd, (char *) matrix.data, total, (off_t) header.dataOffset, true);
+        } else if (ok) {
+            // padded rows: pack a batch of them, then one write per batch
+            const int batch = rowBytes > 0 && rowBytes < CHUNK_BYTES ? (int) (CHUNK_BYTES / rowBytes) : 1;
+            std::vector<char> staging((size_t) batch * rowBytes);
+            for (int i0 = 0; ok && i0 < matrix.rows; i0 += batch) {
+                const int rows = matrix.rows - i0 < batch ? matrix.rows - i0 : batch;
+                for (int i = 0; i < rows; ++i) {
+                    memcpy(&staging[(size_t) i * rowBytes], matrix[i0 + i], rowBytes);
+                }
+                ok = transfer(fd, staging.data(), (size_t) rows * rowBytes,
+                        (off_t) (header.dataOffset + (size_t) i0 * rowBytes), true);
+            }
+        }
+        const int error = errno;
+        if (::close(fd) != 0 && ok) {
+            return false;
+        }
+        errno = error;
+        return ok;
+    }
+
+    template <typename T>
+    bool load(const char *path, BasicMatrix<T> &matrix) {
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        MatrixFileHeader header;
+        struct stat status;
+        bool ok = transfer(fd, (char *) &header, sizeof(header), 0, false) && validHeader(header)
+                && fstat(fd, &status) == 0;
+        if (ok && (header.dtype != Dtype<T>::value || header.layout != LAYOUT_ROW_MAJOR)) {
+            errno = ENOTSUP;
+            ok = false;
+        }
+        if (ok && (uint64_t) status.st_size < header.dataOffset + matrixFileDataBytes(header)) {
+            errno = EINVAL;
+            ok = false;
+        }
+        if (ok) {
+            BasicMatrix<T> loaded((int) header.rows, (int) header.cols);
+            const size_t rowBytes = (size_t) loaded.cols * sizeof(T);
+            // read packed to the front of the buffer, then spread the rows out
+            // to their stride, last row first so nothing unread is overwritten
+            ok = transferParallel(fd, (char *) loaded.data, (size_t) loaded.rows * rowBytes,
+                    (off_t) header.dataOffset, false);
+            if (ok && loaded.stride != loaded.cols) {
+                for (int i = loaded.rows - 1; i > 0; --i) {
+                    memmove(loaded[i], loaded.data + (size_t) i * loaded.cols, rowBytes);
+                }
+            }
+            if (ok) {
+                matrix = std::move(loaded);
+            }
+        }
+        const int error = errno;
+        ::close(fd);
+        errno = error;
+        return ok;
+    }
+
+    // the rows of a createMatrix() array are contiguous, that is a stride == cols matrix
+    template <typename T>
+    bool save(const char *path, T **matrix, const int rows, const int cols) {
+        return save(path, BasicMatrix<T>(rows > 0 ? matrix[0] : NULL, rows, cols, cols));
+    }
+
+    // into a new createMatrix() array, NULL on failure
+    template <typename T>
+    T **load(const char *path, int &rows, int &cols) {
+        BasicMatrix<T> loaded;
+        if (!load(path, loaded)) {
+            return NULL;
+        }
+        rows = loaded.rows;
+        cols = loaded.cols;
+        T **matrix = createMatrix<T>(rows, cols);
+        loaded.copyTo(matrix);
+        return matrix;
+    }
+
+    bool isSpace(const char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    bool isDigit(const char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    const char *skipSpaces(const char *p, const char *end) {
+        while (p < end && isSpace(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    // end of the token at p: up to a separator, blank or line end
+    const char *tokenEnd(const char *p, const char *end) {
+        while (p < end && *p != ',' && *p != ';' && *p != '\n' && !isSpace(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    const char *parseSlow(const char *p, const char *end, double &value) {
+        const char *stop = tokenEnd(p, end);
+        const std::string token(p, stop);
+        char *parsed = NULL;
+        value = strtod(token.c_str(), &parsed);
+        return parsed == token.c_str() + token.size() && !token.empty() ? stop : NULL;
+    }
+
+    // NULL if [p, end) does not start with a number
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 uint128;
+
+    // q * 2^exponent rounded to nearest even; sticky: something non-zero was cut below q
+    double roundBinary(const uint128 q, const bool sticky, const int exponent) {
+        const uint64_t high = (uint64_t) (q >> 64);
+        const int bits = high != 0 ? 128 - __builtin_clzll(high) : 64 - __builtin_clzll((uint64_t) q);
+        if (bits <= 53) {
+            return ldexp((double) (uint64_t) q, exponent);
+        }
+        const int shift = bits - 53;
+        uint64_t mantissa = (uint64_t) (q >> shift);
+        const uint128 rest = q & (((uint128) 1 << shift) - 1), half = (uint128) 1 << (shift - 1);
+        if (rest > half || (rest == half && (sticky || (mantissa & 1)))) {
+            ++mantissa;
+        }
+        return ldexp((double) mantissa, exponent + shift);
+    }
+
+    // mantissa * 10^exponent for |exponent| <= 19, rounded once
+    double scaleExact(const uint64_t mantissa, const int exponent) {
+        static const uint64_t powers[] = {
+                1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+                1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+                100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+                1000000000000000000ull, 10000000000000000000ull};
+        const uint64_t power = powers[exponent < 0 ? -exponent : exponent];
+        if (exponent >= 0) {
+            return roundBinary((uint128) mantissa * power, false, 0);
+        }
+        // at least 55 bits of quotient: 53, a guard bit and one for the remainder;
+        // a long mantissa over a small power has them without a shift
+        const int wanted = 55 + __builtin_clzll(mantissa) - __builtin_clzll(power);
+        const int shift = wanted > 0 ? wanted : 0;
+        const uint128 numerator = (uint128) mantissa << shift;
+        return roundBinary(numerator / power, numerator % power != 0, -shift);
+    }
+#endif
+
+    const char *parseValue(const char *p, const char *end, double &value) {
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        const char *start = p;
+        const bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            ++p;
+        }
+        uint64_t mantissa = 0;
+        int significant = 0, exponent = 0, digits = 0;
+        bool exact = true;
+        for (; p < end && isDigit(*p); ++p, ++digits) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+                significant += mantissa > 0;
+            } else {
+                exact = false;
+            }
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && isDigit(*p); ++p, ++digits) {
+                if (significant < 19) {
+                    mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+                    significant += mantissa > 0;
+                    --exponent;
+                } else {
+                    exact = false;
+                }
+            }
+        }
+        if (digits == 0) {
+            // inf, nan, or not a number at all
+            return parseSlow(start, end, value);
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            const bool negativeExponent = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+')) {
+                ++p;
+            }
+            if (p == end || !isDigit(*p)) {
+                return parseSlow(start, end, value);
+            }
+            int e = 0;
+            for (; p < end && isDigit(*p); ++p) {
+                e = e < 100000 ? e * 10 + (*p - '0') : e;
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+        double magnitude;
+        if (exact && mantissa <= ((uint64_t) 1 << 53) && exponent >= -22 && exponent <= 22) {
+            magnitude = exponent < 0 ? (double) mantissa / powers[-exponent] : (double) mantissa * powers[exponent];
+#ifdef __SIZEOF_INT128__
+        } else if (exact && mantissa > 0 && exponent >= -19 && exponent <= 19) {
+            magnitude = scaleExact(mantissa, exponent);
+#endif
+        } else {
+            return parseSlow(start, end, value);
+        }
+        value = negative ? -magnitude : magnitude;
+        return p;
+    }
+
+    // through double: a float is rounded once more, from the double nearest the text
+    const char *parseValue(const char *p, const char *end, float &value) {
+        double wide;
+        p = parseValue(p, end, wide);
+        value = (float) wide;
+        return p;
+    }
+
+    const char *parseInteger(const char *p, const char *end, int64_t &value, const int64_t limit) {
+        const bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            ++p;
+        }
+        const char *digits = p;
+        const uint64_t bound = (uint64_t) limit + (negative ? 1 : 0);
+        uint64_t magnitude = 0;
+        for (; p < end && isDigit(*p); ++p) {
+            const uint64_t digit = (uint64_t) (*p - '0');
+            if (magnitude > (bound - digit) / 10) {
+                return NULL;
+            }
+            magnitude = magnitude * 10 + digit;
+        }
+        if (p == digits) {
+            return NULL;
+        }
+        value = negative ? (int64_t) (0 - magnitude) : (int64_t) magnitude;
+        return p;
+    }
+
+    const char *parseValue(const char *p, const char *end, int64_t &value) {
+        return parseInteger(p, end, value, INT64_MAX);
+    }
+
+    const char *parseValue(const char *p, const char *end, int32_t &value) {
+        int64_t wide;
+        p = parseInteger(p, end, wide, INT32_MAX);
+        value = (int32_t) wide;
+        return p;
+    }
+
+    // element types without a text form (complex): every token is malformed
+    template <typename T>
+    const char *parseValue(const char *, const char *, T &) {
+        return NULL;
+    }
+
+    // start of the next line, or end
+    const char *nextLine(const char *p, const char *end) {
+        const char *line = (const char *) memchr(p, '\n', end - p);
+        return line != NULL ? line + 1 : end;
+    }
+
+    // [p, next) without its line break
+    const char *lineStop(const char *p, const char *next) {
+        return next > p && next[-1] == '\n' ? next - 1 : next;
+    }
+
+    bool blank(const char *p, const char *next) {
+        const char *stop = lineStop(p, next);
+        return skipSpaces(p, stop) == stop;
+    }
+
+    /* One line into row (NULL: only count), returns the values found, -1 on
+    *   a malformed token or more than limit values. Values are separated by
+    *   one ',' or ';' and / or blanks.
+    */
+    template <typename T>
+    int parseLine(const char *p, const char *next, T *row, const int limit) {
+        const char *lineEnd = lineStop(p, next);
+        int count = 0;
+        p = skipSpaces(p, lineEnd);
+        while (p < lineEnd) {
+            T value;
+            const char *next = parseValue(p, lineEnd, value);
+            if (next == NULL || count == limit || (next < lineEnd && tokenEnd(next, lineEnd) != next)) {
+                return -1;
+            }
+            if (row != NULL) {
+                row[count] = value;
+            }
+            ++count;
+            p = skipSpaces(next, lineEnd);
+            if (p < lineEnd && (*p == ',' || *p == ';')) {
+                p = skipSpaces(p + 1, lineEnd);
+                if (p == lineEnd) {
+                    return -1;
+                }
+            }
+        }
+        return count;
+    }
+
+    template <typename T>
+    bool readText(const char *path, BasicMatrix<T> &matrix) {
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            ::close(fd);
+            return false;
+        }
+        const size_t size = (size_t) status.st_size;
+        if (size == 0) {
+            ::close(fd);
+            matrix = BasicMatrix<T>(0, 0);
+            return true;
+        }
+        void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        const char *text = (const char *) mapped, *end = text + size;
+
+        // chunk c owns the lines that start in [bounds[c], bounds[c + 1])
+        const int chunks = (int) (size / CHUNK_BYTES) + 1;
+        std::vector<const char *> bounds(chunks + 1, end);
+        bounds[0] = text;
+        for (int c = 1; c < chunks; ++c) {
+            const char *guess = text + (size_t) c * (size / chunks);
+            bounds[c] = guess > bounds[c - 1] ? nextLine(guess - 1, end) : bounds[c - 1];
+        }
+
+        // non-blank lines per chunk, then a prefix sum gives each chunk's first row
+        std::vector<int> firstRow(chunks + 1, 0);
+        #pragma omp parallel for schedule(dynamic)
+        for (int c = 0; c < chunks; ++c) {
+            int lines = 0;
+            for (const char *p = bounds[c]; p < bounds[c + 1]; ) {
+                const char *next = nextLine(p, end);
+                lines += !blank(p, next);
+                p = next;
+            }
+            firstRow[c + 1] = lines;
+        }
+        for (int c = 0; c < chunks; ++c) {
+            firstRow[c + 1] += firstRow[c];
+        }
+
+        // the first non-blank line fixes the number of columns
+        int cols = 0;
+        for (const char *p = text; p < end && cols == 0; ) {
+            const char *next = nextLine(p, end);
+            cols = parseLine<T>(p, next, NULL, INT32_MAX);
+            p = next;
+        }
+        bool ok = cols >= 0;
+        BasicMatrix<T> parsed(firstRow[chunks], cols > 0 ? cols : 0);
+        if (ok) {
+            #pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+            for (int c = 0; c < chunks; ++c) {
+                int row = firstRow[c];
+                for (const char *p = bounds[c]; ok && p < bounds[c + 1]; ) {
+                    const char *next = nextLine(p, end);
+                    if (!blank(p, next)) {
+                        ok = parseLine(p, next, parsed[row++], cols) == cols;
+                    }
+                    p = next;
+                }
+            }
+        }
+        munmap(mapped, size);
+        if (!ok) {
+            errno = EINVAL;
+            return false;
+        }
+        matrix = std::move(parsed);
+        return true;
+    }
+
+    int formatValue(char *out, const size_t room, const double value, const int precision) {
+        return snprintf(out, room, "%.*g", precision > 0 && precision < 17 ? precision : 17, value);
+    }
+
+    int formatValue(char *out, const size_t room, const float value, const int precision) {
+        return snprintf(out, room, "%.*g", precision > 0 ? (precision < 17 ? precision : 17) : 9, (double) value);
+    }
+
+    int formatValue(char *out, const size_t room, const int32_t value, const int) {
+        return snprintf(out, room, "%d", value);
+    }
+
+    int formatValue(char *out, const size_t room, const int64_t value, const int) {
+        return snprintf(out, room, "%lld", (long long) value);
+    }
+
+    template <typename T>
+    int formatValue(char *, const size_t, const T &, const int) {
+        return -1;
+    }
+
+    /* One row per line, values separated by separator
+    *   precision: significant digits, 0 for enough to read the same value
+    *   back (17 for double, 9 for float); more than 17 adds nothing and is
+    *   cut to 17, so a value always fits its width
+    */
+    template <typename T>
+    bool writeText(const char *path, const BasicMatrix<T> &matrix, const char separator = ',', const int precision = 0) {
+        FILE *out = fopen(path, "w");
+        if (out == NULL) {
+            return false;
+        }
+        // %.17g of a double is at most 24 characters, plus the separator
+        const size_t width = 26;
+        const size_t batch = matrix.cols > 0 && (size_t) matrix.cols < WRITE_BATCH ? WRITE_BATCH / matrix.cols : 1;
+        std::vector<std::vector<char> > lines(batch, std::vector<char>((size_t) matrix.cols * width + 2));
+        std::vector<size_t> lengths(batch);
+        bool ok = true;
+        for (int i0 = 0; ok && i0 < matrix.rows; i0 += (int) batch) {
+            const int rows = matrix.rows - i0 < (int) batch ? matrix.rows - i0 : (int) batch;
+            #pragma omp parallel for schedule(dynamic, 16)
+            for (int r = 0; r < rows; ++r) {
+                char *line = lines[r].data();
+                const T *row = matrix[i0 + r];
+                size_t length = 0;
+                bool formatted = true;
+                for (int j = 0; formatted && j < matrix.cols; ++j) {
+                    if (j > 0) {
+                        line[length++] = separator;
+                    }
+                    const int written = formatValue(line + length, width, row[j], precision);
+                    formatted = written >= 0 && (size_t) written < width;
+                    length += formatted ? written : 0;
+                }
+                line[length++] = '\n';
+                lengths[r] = formatted ? length : 0;
+            }
+            for (int r = 0; ok && r < rows; ++r) {
+                if (lengths[r] == 0) {
+                    errno = ENOTSUP;
+                    ok = false;
+                } else {
+                    ok = fwrite(lines[r].data(), 1, lengths[r], out) == lengths[r];
+                }
+            }
+        }
+        const int error = errno;
+        if (fclose(out) != 0 && ok) {
+            return false;
+        }
+        errno = error;
+        return ok;
+    }
+
+    // separator of a text file by extension, 0 for binary
+    char textSeparator(const char *path) {
+        const char *dot = strrchr(path, '.');
+        if (dot == NULL) {
+            return 0;
+        }
+        return !strcmp(dot, ".csv") ? ',' : !strcmp(dot, ".tsv") ? '\t' : !strcmp(dot, ".txt") ? ' ' : 0;
+    }
+
+    // binary if the file starts with the matrixFile.h magic, text otherwise
+    template <typename T>
+    bool read(const char *path, BasicMatrix<T> &matrix) {
+        char magic[sizeof(MATRIX_FILE_MAGIC) - 1];
+        FILE *in = fopen(path, "rb");
+        if (in == NULL) {
+            return false;
+        }
+        const bool binary = fread(magic, 1, sizeof(magic), in) == sizeof(magic)
+                && memcmp(magic, MATRIX_FILE_MAGIC, sizeof(magic)) == 0;
+        fclose(in);
+        return binary ? load(path, matrix) : readText(path, matrix);
+    }
+
+    template <typename T>
+    bool write(const char *path, const BasicMatrix<T> &matrix) {
+        const char separator = textSeparator(path);
+        return separator != 0 ? writeText(path, matrix, separator) : save(path, matrix);
+    }
+}
+
+#endif
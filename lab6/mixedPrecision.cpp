@@ -0,0 +1,411 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include "matrix.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MIXED_X86 1
+#endif
+
+/* Mixed precision Winograd
+*       result (double) = first * second, operands stored as float or bfloat16
+*   Storage is half (float) or a quarter (bfloat16) of the bytes of double, so
+*   the operand streams cost that much less memory traffic; every element is
+*   widened to double as it is loaded and all sums and products run in double.
+*   Winograd's form adds first[i][2k] + second[2k+1][j] before multiplying and
+*   subtracts rowFactor[i] + columnFactor[j] at the end; both are large when
+*   the entries are, so the result is what is left after cancelling them.
+*   compensated = true accumulates every sum (factors and result) with Kahan
+*   summation, which takes the length of the sum out of the rounding error.
+*   Loop order and blocking are the ones of the vectorized engine: a strip of
+*   PAIRS_BLOCK pairs of rows x COLUMNS_BLOCK columns of second stays in L2
+*   while every row of first passes over it, ROWS_BLOCK rows at a time, and j
+*   maps onto SIMD lanes (AVX-512F, AVX2 or the build target, picked at run
+*   time). The Kahan compensation of a column block is kept per element.
+*
+* Higham. Accuracy and Stability of Numerical Algorithms, 2nd Ed.
+*       3.5 (inner products), 4.3 (compensated summation), 23.2.2 (Winograd)
+*   Error report, relative to s_ij = sum_p |first[i][p]| |second[p][j]| of the
+*   double operands, on a sample of entries:
+*       measured    |result - classical product in double (compensated)| / s_ij
+*       bound       storage rounding 2u_s + u_s^2 plus accumulation
+*                   gamma(k/2 + 5) w_ij / s_ij, or (2u + gamma(5) + k u^2) w_ij / s_ij
+*                   compensated, with u = 2^-53, u_s the unit roundoff of the
+*                   storage type and w_ij the same sum over the absolute values
+*                   of every Winograd term (pair products and both factors)
+*   measured <= bound always holds; w_ij / s_ij is the price of Winograd's
+*   cancellation and can be large when first and second differ in scale.
+*/
+namespace mixed {
+    const int COLUMNS_BLOCK = 256;
+    const int PAIRS_BLOCK = 128;
+    const int ROWS_BLOCK = 4;
+
+    // upper half of an IEEE single, 8 bit significand
+    struct bfloat16 {
+        uint16_t bits;
+    };
+
+    enum Storage {
+        FLOAT32,
+        BFLOAT16
+    };
+
+    struct Options {
+        Storage storage;
+        bool compensated;
+        bool parallel;
+        int samples;            // entries the error report checks, 0: no report
+
+        Options() : storage(FLOAT32), compensated(false), parallel(true), samples(256) {}
+    };
+
+    struct ErrorReport {
+        int samples;
+        double measured;
+        double bound;
+    };
+
+    inline double widen(const float value) {
+        return value;
+    }
+
+    inline double widen(const bfloat16 value) {
+        const uint32_t bits = (uint32_t) value.bits << 16;
+        float single;
+        memcpy(&single, &bits, sizeof(single));
+        return single;
+    }
+
+    inline void narrow(const double value, float &stored) {
+        stored = (float) value;
+    }
+
+    // round to nearest even on the dropped 16 bits, NaN stays NaN
+    inline void narrow(const double value, bfloat16 &stored) {
+        const float single = (float) value;
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        if ((bits & 0x7fffffffu) > 0x7f800000u) {
+            stored.bits = (uint16_t) ((bits >> 16) | 0x40);
+            return;
+        }
+        bits += 0x7fffu + ((bits >> 16) & 1);
+        stored.bits = (uint16_t) (bits >> 16);
+    }
+
+    // unit roundoff of the storage type
+    inline double roundoff(const Storage storage) {
+        return storage == BFLOAT16 ? ldexp(1.0, -8) : ldexp(1.0, -24);
+    }
+
+    template <typename S>
+    BasicMatrix<S> store(const Matrix &source) {
+        BasicMatrix<S> stored(source.rows, source.cols);
+        for (int i = 0; i < source.rows; ++i) {
+            const double *row = source[i];
+            S *out = stored[i];
+            for (int j = 0; j < source.cols; ++j) {
+                narrow(row[j], out[j]);
+            }
+        }
+        return stored;
+    }
+
+    // sum += term, Kahan
+    inline void compensate(double &sum, double &carry, const double term) {
+        const double y = term - carry;
+        const double t = sum + y;
+        carry = (t - sum) - y;
+        sum = t;
+    }
+
+    /* Strip: ROWS_BLOCK rows of first against pairs k0 .. k0 + pairs, columns
+    *   j0 .. j0 + width of second
+    *       out[r][j] += sum_k (a[r][2k] + odd_k[j]) * (a[r][2k+1] + even_k[j])
+    *   a[r] points at column 2 k0 of its row. The same C is compiled once per
+    *   instruction set below, the widest one the host has is picked at runtime.
+    */
+    template <typename S, bool compensated>
+    __attribute__((always_inline)) inline void stripBody(double *const *out, double *const *carry,
+            const S *const *a, const BasicMatrix<S> &second, const int k0, const int pairs,
+            const int j0, const int width) {
+        for (int k = 0; k < pairs; ++k) {
+            const S *even = second[2 * (k0 + k)] + j0, *odd = second[2 * (k0 + k) + 1] + j0;
+            double x[ROWS_BLOCK], y[ROWS_BLOCK];
+            for (int r = 0; r < ROWS_BLOCK; ++r) {
+                x[r] = widen(a[r][2 * k]);
+                y[r] = widen(a[r][2 * k + 1]);
+            }
+            #pragma omp simd
+            for (int j = 0; j < width; ++j) {
+                const double e = widen(even[j]), o = widen(odd[j]);
+                #pragma GCC unroll 4
+                for (int r = 0; r < ROWS_BLOCK; ++r) {
+                    const double term = (x[r] + o) * (y[r] + e);
+                    if (compensated) {
+                        compensate(out[r][j], carry[r][j], term);
+                    } else {
+                        out[r][j] += term;
+                    }
+                }
+            }
+        }
+    }
+
+    template <typename S, bool compensated>
+    static void stripPlain(double *const *out, double *const *carry, const S *const *a,
+            const BasicMatrix<S> &second, const int k0, const int pairs, const int j0, const int width) {
+        stripBody<S, compensated>(out, carry, a, second, k0, pairs, j0, width);
+    }
+
+#ifdef MIXED_X86
+    template <typename S, bool compensated>
+    __attribute__((target("avx2")))
+    static void stripAvx2(double *const *out, double *const *carry, const S *const *a,
+            const BasicMatrix<S> &second, const int k0, const int pairs, const int j0, const int width) {
+        stripBody<S, compensated>(out, carry, a, second, k0, pairs, j0, width);
+    }
+
+    template <typename S, bool compensated>
+    __attribute__((target("avx512f")))
+    static void stripAvx512(double *const *out, double *const *carry, const S *const *a,
+            const BasicMatrix<S> &second, const int k0, const int pairs, const int j0, const int width) {
+        stripBody<S, compensated>(out, carry, a, second, k0, pairs, j0, width);
+    }
+#endif
+
+    template <typename S, bool compensated>
+    struct Strip {
+        typedef void (*Kernel)(double *const *, double *const *, const S *const *,
+                const BasicMatrix<S> &, const int, const int, const int, const int);
+
+        static Kernel select() {
+#ifdef MIXED_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return &stripAvx512<S, compensated>;
+            }
+            if (__builtin_cpu_supports("avx2")) {
+                return &stripAvx2<S, compensated>;
+            }
+#endif
+            return &stripPlain<S, compensated>;
+        }
+
+        static Kernel kernel() {
+            static const Kernel selected = select();
+            return selected;
+        }
+    };
+
+    template <typename S>
+    void stripRows(const Matrix &result, const Matrix &carry, const BasicMatrix<S> &first,
+            const BasicMatrix<S> &second, const int j0, const int width, const int k0, const int pairs,
+            const bool compensated, double *dummyOut, const S *dummyIn) {
+        const int m = result.rows;
+        const typename Strip<S, true>::Kernel kernel = compensated ? Strip<S, true>::kernel()
+                : Strip<S, false>::kernel();
+        #pragma omp for
+        for (int i0 = 0; i0 < m; i0 += ROWS_BLOCK) {
+            double *out[ROWS_BLOCK], *c[ROWS_BLOCK];
+            const S *a[ROWS_BLOCK];
+            for (int r = 0; r < ROWS_BLOCK; ++r) {
+                if (i0 + r < m) {
+                    out[r] = result[i0 + r] + j0;
+                    c[r] = compensated ? carry[i0 + r] : dummyOut;
+                    a[r] = first[i0 + r] + 2 * k0;
+                } else {
+                    // only one thread gets the incomplete block
+                    out[r] = c[r] = dummyOut;
+                    a[r] = dummyIn;
+                }
+            }
+            kernel(out, c, a, second, k0, pairs, j0, width);
+        }
+    }
+
+    /* result = first * second on stored operands, result in double
+    *       result m x n, first m x inner, second inner x n
+    */
+    template <typename S>
+    void multiplyStored(const Matrix &result, const BasicMatrix<S> &first, const BasicMatrix<S> &second,
+            const bool compensated, const bool parallel) {
+        const int m = result.rows, n = result.cols, inner = first.cols, d = inner / 2;
+        double *rowFactor = (double *) alignedMalloc((m > 0 ? m : 1) * sizeof(double));
+        double *columnFactor = (double *) alignedMalloc((n > 0 ? n : 1) * sizeof(double));
+        // running compensation of the current column block, rows owned like result's
+        const Matrix carry = compensated ? Matrix(m, COLUMNS_BLOCK) : Matrix();
+        double *dummyOut = (double *) alignedMalloc(COLUMNS_BLOCK * sizeof(double));
+        S *dummyIn = (S *) alignedMalloc(2 * PAIRS_BLOCK * sizeof(S));
+        memset(dummyIn, 0, 2 * PAIRS_BLOCK * sizeof(S));
+
+        #pragma omp parallel if(parallel)
+        {
+            #pragma omp for
+            for (int i = 0; i < m; ++i) {
+                const S *row = first[i];
+                double sum = 0, c = 0;
+                for (int k = 0; k < d; ++k) {
+                    const double term = widen(row[2 * k]) * widen(row[2 * k + 1]);
+                    if (compensated) {
+                        compensate(sum, c, term);
+                    } else {
+                        sum += term;
+                    }
+                }
+                rowFactor[i] = sum - c;
+            }
+
+            #pragma omp for
+            for (int j0 = 0; j0 < n; j0 += COLUMNS_BLOCK) {
+                const int width = n - j0 < COLUMNS_BLOCK ? n - j0 : COLUMNS_BLOCK;
+                double *sum = columnFactor + j0;
+                double c[COLUMNS_BLOCK];
+                for (int j = 0; j < width; ++j) {
+                    sum[j] = 0;
+                    c[j] = 0;
+                }
+                for (int k = 0; k < d; ++k) {
+                    const S *even = second[2 * k] + j0, *odd = second[2 * k + 1] + j0;
+                    for (int j = 0; j < width; ++j) {
+                        const double term = widen(even[j]) * widen(odd[j]);
+                        if (compensated) {
+                            compensate(sum[j], c[j], term);
+                        } else {
+                            sum[j] += term;
+                        }
+                    }
+                }
+                for (int j = 0; j < width; ++j) {
+                    sum[j] -= c[j];
+                }
+            }
+
+            for (int j0 = 0; j0 < n; j0 += COLUMNS_BLOCK) {
+                const int width = n - j0 < COLUMNS_BLOCK ? n - j0 : COLUMNS_BLOCK;
+
+                // odd inner size: the last column of first has no partner
+                #pragma omp for
+                for (int i = 0; i < m; ++i) {
+                    double *out = result[i] + j0;
+                    const double x = inner & 1 ? widen(first[i][inner - 1]) : 0;
+                    const S *last = inner & 1 ? second[inner - 1] + j0 : NULL;
+                    for (int j = 0; j < width; ++j) {
+                        out[j] = -rowFactor[i] - columnFactor[j0 + j];
+                        if (last != NULL) {
+                            out[j] += x * widen(last[j]);
+                        }
+                    }
+                    if (compensated) {
+                        memset(carry[i], 0, width * sizeof(double));
+                    }
+                }
+
+                for (int k0 = 0; k0 < d; k0 += PAIRS_BLOCK) {
+                    const int pairs = d - k0 < PAIRS_BLOCK ? d - k0 : PAIRS_BLOCK;
+                    stripRows(result, carry, first, second, j0, width, k0, pairs, compensated, dummyOut, dummyIn);
+                }
+
+                if (compensated) {
+                    #pragma omp for
+                    for (int i = 0; i < m; ++i) {
+                        double *out = result[i] + j0;
+                        const double *c = carry[i];
+                        for (int j = 0; j < width; ++j) {
+                            out[j] -= c[j];
+                        }
+                    }
+                }
+            }
+        }
+
+        alignedFree(rowFactor);
+        alignedFree(columnFactor);
+        alignedFree(dummyOut);
+        alignedFree(dummyIn);
+    }
+
+    // gamma(n) = n u / (1 - n u), Higham 3.1
+    inline double gamma(const double n, const double u) {
+        return n * u / (1 - n * u);
+    }
+
+    /* Checks `samples` entries of result against the classical product of the
+    *   double operands, see the error report above; spread over all rows, the
+    *   columns walk with a large odd step
+    */
+    template <typename S>
+    ErrorReport checkError(const Matrix &result, const Matrix &first, const Matrix &second,
+            const BasicMatrix<S> &storedFirst, const BasicMatrix<S> &storedSecond,
+            const double storageRoundoff, const bool compensated, const int samples) {
+        const int m = result.rows, n = result.cols, inner = first.cols, d = inner / 2;
+        const double u = DBL_EPSILON / 2;
+        const double accumulation = compensated ? 2 * u + gamma(5, u) + 2 * d * u * u : gamma(d + 5, u);
+        const double storage = 2 * storageRoundoff + storageRoundoff * storageRoundoff;
+        const long long elements = (long long) m * n;
+        ErrorReport report;
+        report.samples = elements < samples ? (int) elements : samples;
+        report.measured = 0;
+        report.bound = 0;
+
+        for (int s = 0; s < report.samples; ++s) {
+            const int i = (int) ((long long) s * m / report.samples);
+            const int j = (int) (((long long) s * 7919) % n);
+            double exact = 0, carry = 0, scale = 0, terms = 0;
+            for (int p = 0; p < inner; ++p) {
+                compensate(exact, carry, first[i][p] * second[p][j]);
+                scale += fabs(first[i][p] * second[p][j]);
+            }
+            const S *row = storedFirst[i];
+            for (int k = 0; k < d; ++k) {
+                const double x = widen(row[2 * k]), y = widen(row[2 * k + 1]);
+                const double even = widen(storedSecond[2 * k][j]), odd = widen(storedSecond[2 * k + 1][j]);
+                terms += (fabs(x) + fabs(odd)) * (fabs(y) + fabs(even)) + fabs(x * y) + fabs(even * odd);
+            }
+            if (inner & 1) {
+                terms += fabs(widen(row[inner - 1]) * widen(storedSecond[inner - 1][j]));
+            }
+            const double error = fabs(result[i][j] - (exact - carry));
+            if (scale > 0) {
+                report.measured = std::max(report.measured, error / scale);
+                report.bound = std::max(report.bound, storage + accumulation * terms / scale);
+            }
+        }
+        return report;
+    }
+
+    template <typename S>
+    ErrorReport multiplyAs(const Matrix &result, const Matrix &first, const Matrix &second, const Options &options) {
+        const BasicMatrix<S> a = store<S>(first), b = store<S>(second);
+        multiplyStored(result, a, b, options.compensated, options.parallel);
+        if (options.samples <= 0) {
+            ErrorReport none = {0, 0, 0};
+            return none;
+        }
+        return checkError(result, first, second, a, b, roundoff(options.storage), options.compensated, options.samples);
+    }
+
+    /* Rounds first and second to the storage type, multiplies and checks the
+    *   result; keep the operands stored (store + multiplyStored) to pay the
+    *   conversion only once when they are used again
+    */
+    ErrorReport multiply(Matrix &result, const Matrix &first, const Matrix &second,
+            const Options &options = Options()) {
+        if (options.storage == BFLOAT16) {
+            return multiplyAs<bfloat16>(result, first, second, options);
+        }
+        return multiplyAs<float>(result, first, second, options);
+    }
+
+    void multiply(double **result, double **first, double **second, const int size,
+            const Options &options = Options()) {
+        Matrix a(size, size), b(size, size), c(size, size);
+        a.copyFrom(first);
+        b.copyFrom(second);
+        multiply(c, a, b, options);
+        c.copyTo(result);
+    }
+}
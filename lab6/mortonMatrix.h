@@ -0,0 +1,136 @@
+#ifndef MORTON_MATRIX_H
+#define MORTON_MATRIX_H
+
+#include <stdint.h>
+#include <string.h>
+#include "matrix.h"
+
+/* Morton (Z-order) tiled matrix
+*       the matrix is cut into a 2^levels x 2^levels grid of tileRows x
+*       tileCols tiles, every tile is row-major (rows tileStride apart) and
+*       the tiles follow each other in Z order: r s t u of the first split,
+*       each of them again r s t u, and so on
+*   Every quadrant at every level of a halving recursion is therefore one
+*   contiguous block (see quadrant()), a quarter of its parent.
+*   rows x cols is padded up to tileRows * 2^levels x tileCols * 2^levels;
+*   copyFrom() zeroes the padding, so products of padded matrices are exact.
+*   Matrices multiplied together must have the same levels, see
+*   recursiveInPlace::mortonLevels().
+*/
+template <typename T>
+class MortonMatrix {
+public:
+    T *data;
+    int rows;
+    int cols;
+    int levels;
+    int tileRows;
+    int tileCols;
+    int tileStride;
+
+    MortonMatrix(const int rows, const int cols, const int levels)
+            : rows(rows), cols(cols), levels(levels),
+              tileRows(((rows > 0 ? rows : 1) + (1 << levels) - 1) >> levels),
+              tileCols(((cols > 0 ? cols : 1) + (1 << levels) - 1) >> levels),
+              tileStride(BasicMatrix<T>::paddedStride(tileCols)) {
+        data = (T *) alignedMalloc(tiles() * tileSize() * sizeof(T));
+    }
+
+    ~MortonMatrix() {
+        alignedFree(data);
+    }
+
+    MortonMatrix(const MortonMatrix &) = delete;
+    MortonMatrix &operator=(const MortonMatrix &) = delete;
+
+    size_t tiles() const {
+        return (size_t) 1 << (2 * levels);
+    }
+
+    size_t tileSize() const {
+        return (size_t) tileRows * tileStride;
+    }
+
+    // elements of one quadrant `depth` splits down, from its first element
+    size_t quadrant(const int depth) const {
+        return tileSize() << (2 * (levels - depth));
+    }
+
+    // first element of tile (ti, tj)
+    T *tile(const int ti, const int tj) const {
+        return data + index(ti, tj) * tileSize();
+    }
+
+    T &at(const int i, const int j) const {
+        return tile(i / tileRows, j / tileCols)[(i % tileRows) * tileStride + j % tileCols];
+    }
+
+    void fill(const T value) const {
+        const size_t elements = tiles() * tileSize();
+        for (size_t e = 0; e < elements; ++e) {
+            data[e] = value;
+        }
+    }
+
+    // row-major -> Z order, one memcpy per tile row; padding becomes zero
+    void copyFrom(const BasicMatrix<T> &src) const {
+        const int grid = 1 << levels;
+        #pragma omp parallel for schedule(static)
+        for (int ti = 0; ti < grid; ++ti) {
+            for (int tj = 0; tj < grid; ++tj) {
+                T *out = tile(ti, tj);
+                const int i0 = ti * tileRows, j0 = tj * tileCols;
+                const int width = clamp(cols - j0, tileCols);
+                for (int i = 0; i < tileRows; ++i) {
+                    T *row = out + (size_t) i * tileStride;
+                    const int copied = i0 + i < rows ? width : 0;
+                    if (copied > 0) {
+                        memcpy(row, src[i0 + i] + j0, copied * sizeof(T));
+                    }
+                    for (int j = copied; j < tileCols; ++j) {
+                        row[j] = T();
+                    }
+                }
+            }
+        }
+    }
+
+    // Z order -> row-major, padding is dropped
+    void copyTo(const BasicMatrix<T> &dst) const {
+        const int grid = 1 << levels;
+        #pragma omp parallel for schedule(static)
+        for (int ti = 0; ti < grid; ++ti) {
+            for (int tj = 0; tj < grid; ++tj) {
+                const T *in = tile(ti, tj);
+                const int i0 = ti * tileRows, j0 = tj * tileCols;
+                const int height = clamp(rows - i0, tileRows), width = clamp(cols - j0, tileCols);
+                for (int i = 0; i < height && width > 0; ++i) {
+                    memcpy(dst[i0 + i] + j0, in + (size_t) i * tileStride, width * sizeof(T));
+                }
+            }
+        }
+    }
+
+    // bits of ti on the odd, bits of tj on the even positions
+    static size_t index(const int ti, const int tj) {
+        return (size_t) (spread((uint32_t) ti) << 1 | spread((uint32_t) tj));
+    }
+
+private:
+    static int clamp(const int left, const int size) {
+        return left < 0 ? 0 : left < size ? left : size;
+    }
+
+    // 0b1011 -> 0b01000101
+    static uint64_t spread(uint32_t x) {
+        uint64_t v = x;
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    }
+};
+
+#endif
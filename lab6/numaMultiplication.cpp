@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <omp.h>
+#include "matrix.h"
+#include "gemmKernel.h"
+#include "scheduler.h"
+
+/* NUMA-aware parallel multiplication
+*       result = first * second on all threads of all nodes
+*   Linux places a page on the node of the thread that touches it first, so
+*   a matrix filled by one thread lives on one node and every other node
+*   reads it over the interconnect. Here every thread is pinned to a cpu of
+*   one node and owns a band of rows:
+*       allocate()      zeroes every row band from the threads of its node,
+*                       so the pages land where they will be used
+*       multiply()      splits each node's band of result into 2D tiles for
+*                       the threads of that node (blocked kernel per tile),
+*                       first and result are only touched node-locally
+*   second is read by every node. If the bands are tall enough to amortize a
+*   copy it is replicated once per node, each copy first-touched by its node.
+*   The pinning lasts for the parallel region only: every thread gets its
+*   previous cpu set back (scheduler::PinnedScope), so the caller and the
+*   threads it starts later are not confined to one cpu.
+*   Topology comes from /sys/devices/system/node; elsewhere, or without that
+*   tree, everything is one node and this is a plain pinned 2D-tiled multiply.
+*/
+namespace numa {
+    // tile of result computed by one thread, shrunk until every thread has a few
+    int tileRows = 128;
+    int tileCols = 1024;
+    // replicate second once a node's band has at least this many rows
+    int replicateRows = 256;
+
+    struct Topology {
+        std::vector<std::vector<int> > cpus;    // per node
+
+        int nodes() const {
+            return (int) cpus.size();
+        }
+    };
+
+    // "0-3,8-11" -> 0 1 2 3 8 9 10 11
+    static std::vector<int> parseCpuList(const char *text) {
+        std::vector<int> list;
+        const char *c = text;
+        while (*c != '\0' && *c != '\n') {
+            int first = 0, last;
+            while (*c >= '0' && *c <= '9') {
+                first = first * 10 + (*c++ - '0');
+            }
+            last = first;
+            if (*c == '-') {
+                ++c;
+                last = 0;
+                while (*c >= '0' && *c <= '9') {
+                    last = last * 10 + (*c++ - '0');
+                }
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                list.push_back(cpu);
+            }
+            if (*c == ',') {
+                ++c;
+            } else {
+                break;
+            }
+        }
+        return list;
+    }
+
+    static Topology detect() {
+        Topology topology;
+#ifdef __linux__
+        for (int node = 0; ; ++node) {
+            char path[96];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+            FILE *file = fopen(path, "r");
+            if (file == NULL) {
+                break;
+            }
+            char line[4096];
+            if (fgets(line, sizeof(line), file) != NULL) {
+                const std::vector<int> cpus = parseCpuList(line);
+                // memory-only nodes have no cpus to run on
+                if (!cpus.empty()) {
+                    topology.cpus.push_back(cpus);
+                }
+            }
+            fclose(file);
+        }
+#endif
+        if (topology.cpus.empty()) {
+            const int count = (int) std::thread::hardware_concurrency();
+            topology.cpus.push_back(std::vector<int>());
+            for (int cpu = 0; cpu < (count > 0 ? count : 1); ++cpu) {
+                topology.cpus[0].push_back(cpu);
+            }
+        }
+        return topology;
+    }
+
+    const Topology &topology() {
+        static const Topology detected = detect();
+        return detected;
+    }
+
+    /* Thread t of a team of `threads`
+    *       node:  t * nodes / threads, so every node gets a contiguous block
+    *              of thread numbers of (nearly) equal size
+    *       cpu:   the cpus of that node in order, wrapping when oversubscribed
+    *   A node's row band is proportional to its share of the threads.
+    */
+    struct Placement {
+        int threads;
+        std::vector<int> node;
+        std::vector<int> cpu;
+        std::vector<int> firstThread;           // per node, plus threads at the end
+
+        explicit Placement(const int threads) : threads(threads) {
+            const Topology &t = topology();
+            const int nodes = threads < t.nodes() ? threads : t.nodes();
+            for (int i = 0; i < threads; ++i) {
+                node.push_back((int) ((long long) i * nodes / threads));
+            }
+            for (int n = 0, i = 0; n <= nodes; ++n) {
+                while (i < threads && node[i] < n) {
+                    ++i;
+                }
+                firstThread.push_back(i);
+            }
+            for (int i = 0; i < threads; ++i) {
+                const std::vector<int> &cpus = t.cpus[node[i]];
+                cpu.push_back(cpus[(i - firstThread[node[i]]) % cpus.size()]);
+            }
+        }
+
+        int nodes() const {
+            return (int) firstThread.size() - 1;
+        }
+
+        int threadsOf(const int n) const {
+            return firstThread[n + 1] - firstThread[n];
+        }
+
+        // rows [bandStart(n), bandStart(n + 1)) belong to node n
+        int bandStart(const int n, const int rows) const {
+            return (int) ((long long) rows * firstThread[n] / threads);
+        }
+    };
+
+    // cpu of the calling OpenMP thread of the team, its pinning ends with the
+    // parallel region; a team can come out smaller than asked (nested,
+    // OMP_DYNAMIC, thread limit), so thread t then also does the shares of
+    // t + team, t + 2 team, ..
+    static int cpuOf(const Placement &placement) {
+        return placement.cpu[omp_get_thread_num()];
+    }
+
+    // part [from, to) of n items for thread `local` of `count`
+    static void share(const int n, const int local, const int count, int &from, int &to) {
+        from = (int) ((long long) n * local / count);
+        to = (int) ((long long) n * (local + 1) / count);
+    }
+
+    // zeroed rows x cols matrix, every row band first-touched by its node
+    Matrix allocate(const int rows, const int cols) {
+        Matrix matrix(rows, cols);
+        const Placement placement(omp_get_max_threads());
+        #pragma omp parallel num_threads(placement.threads)
+        {
+            const scheduler::PinnedScope pinned(cpuOf(placement));
+            const int team = omp_get_num_threads();
+            for (int t = omp_get_thread_num(); t < placement.threads; t += team) {
+                const int node = placement.node[t];
+                const int start = placement.bandStart(node, rows), end = placement.bandStart(node + 1, rows);
+                int from, to;
+                share(end - start, t - placement.firstThread[node], placement.threadsOf(node), from, to);
+                for (int i = start + from; i < start + to; ++i) {
+                    memset(matrix[i], 0, matrix.stride * sizeof(double));
+                }
+            }
+        }
+        return matrix;
+    }
+
+    // copies source into a matrix from allocate(), each band by its own node
+    void copyFrom(const Matrix &placed, double **source) {
+        const Placement placement(omp_get_max_threads());
+        #pragma omp parallel num_threads(placement.threads)
+        {
+            const scheduler::PinnedScope pinned(cpuOf(placement));
+            const int team = omp_get_num_threads();
+            for (int t = omp_get_thread_num(); t < placement.threads; t += team) {
+                const int node = placement.node[t];
+                const int start = placement.bandStart(node, placed.rows);
+                const int end = placement.bandStart(node + 1, placed.rows);
+                int from, to;
+                share(end - start, t - placement.firstThread[node], placement.threadsOf(node), from, to);
+                for (int i = start + from; i < start + to; ++i) {
+                    memcpy(placed[i], source[i], placed.cols * sizeof(double));
+                }
+            }
+        }
+    }
+
+    void multiply(Matrix &result, const Matrix &first, const Matrix &second) {
+        const int m = result.rows, n = result.cols, k = first.cols;
+        const Placement placement(omp_get_max_threads());
+        const int nodes = placement.nodes();
+        const bool replicate = nodes > 1 && m / nodes >= replicateRows;
+
+        std::vector<double *> replicas(nodes, (double *) NULL);
+        if (replicate) {
+            // untouched until the node's own threads copy into it
+            for (int node = 0; node < nodes; ++node) {
+                replicas[node] = (double *) alignedMalloc((size_t) k * second.stride * sizeof(double));
+            }
+        }
+
+        #pragma omp parallel num_threads(placement.threads)
+        {
+            const scheduler::PinnedScope pinned(cpuOf(placement));
+            const int running = omp_get_num_threads(), self = omp_get_thread_num();
+
+            if (replicate) {
+                for (int t = self; t < placement.threads; t += running) {
+                    const int node = placement.node[t];
+                    int from, to;
+                    share(k, t - placement.firstThread[node], placement.threadsOf(node), from, to);
+                    for (int i = from; i < to; ++i) {
+                        memcpy(replicas[node] + (size_t) i * second.stride, second[i], n * sizeof(double));
+                    }
+                }
+                #pragma omp barrier
+            }
+
+            for (int t = self; t < placement.threads; t += running) {
+                const int node = placement.node[t];
+                const int local = t - placement.firstThread[node], team = placement.threadsOf(node);
+                const Matrix B = replicate ? Matrix(replicas[node], k, n, second.stride) : second.view(0, 0, k, n);
+
+                // 2D tiles of this node's band, enough of them for every thread
+                const int start = placement.bandStart(node, m), rows = placement.bandStart(node + 1, m) - start;
+                int tr = tileRows, tc = tileCols;
+                while (((rows + tr - 1) / tr) * ((n + tc - 1) / tc) < 4 * team && (tr > 16 || tc > 64)) {
+                    if (tc > 64 && tc >= tr) {
+                        tc /= 2;
+                    } else {
+                        tr /= 2;
+                    }
+                }
+                const int tilesDown = (rows + tr - 1) / tr, tilesAcross = (n + tc - 1) / tc;
+                for (int tile = local; tile < tilesDown * tilesAcross; tile += team) {
+                    const int i0 = start + tile / tilesAcross * tr, j0 = tile % tilesAcross * tc;
+                    const int h = start + rows - i0 < tr ? start + rows - i0 : tr;
+                    const int w = n - j0 < tc ? n - j0 : tc;
+                    kernel::clear(result, i0, j0, h, w);
+                    kernel::multiplyAdd(result, i0, j0, first, i0, 0, B, 0, j0, h, w, k);
+                }
+            }
+        }
+
+        for (int node = 0; node < nodes; ++node) {
+            alignedFree(replicas[node]);
+        }
+    }
+
+    void multiply(double **result, double **first, double **second, const int size) {
+        Matrix a = allocate(size, size), b = allocate(size, size), c = allocate(size, size);
+        copyFrom(a, first);
+        copyFrom(b, second);
+        multiply(c, a, b);
+        c.copyTo(result);
+    }
+}
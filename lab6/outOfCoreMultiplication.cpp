@@ -0,0 +1,82 @@
+#include <errno.h>
+#include "matrix.h"
+#include "matrixFile.h"
+#include "scheduler.h"
+#include "recursiveMultiplicationInPlace.cpp"
+
+/* Out-of-core multiplication on memory mapped files (matrixFile.h)
+*       result = first * second, tile by tile:
+*           C(ti, tj) = sum_p A(ti, p) * B(p, tj)
+*   Every tile product runs in core on the zero-copy tile views with the
+*   recursive in-place engine (recursiveInPlace, accumulating).
+*   While one product computes, the tiles of the next one are requested with
+*   madvise(MADV_WILLNEED) so the kernel reads them in the background. Input
+*   tiles are dropped once used and written result tiles are scheduled for
+*   write back, so the resident set stays around a panel of first plus a few
+*   tiles, however large the files are.
+*   Tile grids have to agree: first is tr x tk, second tk x tc, result tr x tc.
+*/
+namespace outOfCore {
+    static void inCore(const Matrix &C, const Matrix &A, const Matrix &B, const bool parallel) {
+        if (parallel) {
+            scheduler::pool().run([&]() { recursiveInPlace::multParallel(C, A, B); });
+        } else {
+            recursiveInPlace::multSerial(C, A, B);
+        }
+    }
+
+    // false (errno = EINVAL) if shapes or tile grids do not fit together
+    bool multiply(const MappedMatrix &result, const MappedMatrix &first, const MappedMatrix &second,
+            const bool parallel = true) {
+        if (first.cols() != second.rows() || result.rows() != first.rows() || result.cols() != second.cols()
+                || first.tileWidth() != second.tileHeight() || result.tileHeight() != first.tileHeight()
+                || result.tileWidth() != second.tileWidth()) {
+            errno = EINVAL;
+            return false;
+        }
+        const int down = result.tilesDown(), across = result.tilesAcross(), inner = first.tilesAcross();
+        if (inner > 0) {
+            first.prefetch(0, 0);
+            second.prefetch(0, 0);
+        }
+        for (int ti = 0; ti < down; ++ti) {
+            for (int tj = 0; tj < across; ++tj) {
+                const Matrix C = result.tile(ti, tj);
+                C.fill(0);
+                for (int p = 0; p < inner; ++p) {
+                    // the pair after this one: next p, else next tile of result
+                    if (p + 1 < inner) {
+                        first.prefetch(ti, p + 1);
+                        second.prefetch(p + 1, tj);
+                    } else if (tj + 1 < across) {
+                        first.prefetch(ti, 0);
+                        second.prefetch(0, tj + 1);
+                    } else if (ti + 1 < down) {
+                        first.prefetch(ti + 1, 0);
+                        second.prefetch(0, 0);
+                    }
+                    inCore(C, first.tile(ti, p), second.tile(p, tj), parallel);
+                    second.drop(p, tj);
+                }
+                result.flush(ti, tj);
+            }
+            for (int p = 0; p < inner; ++p) {
+                first.drop(ti, p);
+            }
+        }
+        result.flush(true);
+        return true;
+    }
+
+    // result file gets a tiled layout matching the inputs
+    bool multiply(const char *resultPath, const char *firstPath, const char *secondPath, const bool parallel = true) {
+        MappedMatrix first, second, result;
+        if (!first.open(firstPath, false) || !second.open(secondPath, false)) {
+            return false;
+        }
+        if (!result.create(resultPath, first.rows(), second.cols(), first.tileHeight(), second.tileWidth())) {
+            return false;
+        }
+        return multiply(result, first, second, parallel);
+    }
+}
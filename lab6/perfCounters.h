@@ -0,0 +1,374 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+/* Hardware performance counters (Linux perf_event_open)
+*       cycles, instructions, L1D read misses, LLC misses and retired double
+*       precision FP instructions, user space only
+*   Build with -DPERF_COUNTERS (cmake -DPERF_COUNTERS=ON) to enable. Without
+*   it this header only defines PERF_LEVEL_SCOPE() as nothing, so the engines
+*   carry no instrumentation at all.
+*   Two views:
+*       ProcessCounters     one counter group per thread of the process,
+*                           summed, for a whole engine call (benchmark.h)
+*       PERF_LEVEL_SCOPE()  per recursion level: every thread keeps its own
+*                           group, a scope adds the counts of its thread that
+*                           were not spent in nested scopes (exclusive) to the
+*                           level it belongs to
+*   Counters the host does not offer (VMs, the FP event off Intel cpus, paranoid
+*   kernels) are reported as unavailable instead of failing.
+*/
+#ifdef PERF_COUNTERS
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include <mutex>
+#include <vector>
+#include "scheduler.h"
+
+namespace perf {
+    enum Event {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,
+        LLC_MISSES,
+        FP_OPS,
+        EVENTS
+    };
+
+    const char *eventNames[EVENTS] = {"cycles", "instructions", "l1d_misses", "llc_misses", "fp_ops"};
+
+    struct Counts {
+        uint64_t value[EVENTS];
+        bool valid[EVENTS];
+
+        Counts() {
+            for (int e = 0; e < EVENTS; ++e) {
+                value[e] = 0;
+                valid[e] = false;
+            }
+        }
+
+        Counts &operator+=(const Counts &other) {
+            for (int e = 0; e < EVENTS; ++e) {
+                value[e] += other.value[e];
+                valid[e] = valid[e] || other.valid[e];
+            }
+            return *this;
+        }
+
+        Counts operator-(const Counts &other) const {
+            Counts difference;
+            for (int e = 0; e < EVENTS; ++e) {
+                difference.value[e] = value[e] > other.value[e] ? value[e] - other.value[e] : 0;
+                difference.valid[e] = valid[e];
+            }
+            return difference;
+        }
+    };
+
+    // raw event codes are vendor specific: another vendor's PMU takes them
+    // and counts something unrelated
+    static bool isIntel() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int level, ebx, ecx, edx;
+        return __get_cpuid(0, &level, &ebx, &ecx, &edx)
+                && ebx == 0x756e6547 && edx == 0x49656e69 && ecx == 0x6c65746e;     // "GenuineIntel"
+#else
+        return false;
+#endif
+    }
+
+    // false if the host has no such counter
+    static bool describe(const int event, perf_event_attr &attr) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        switch (event) {
+            case CYCLES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case INSTRUCTIONS:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case L1D_MISSES:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            case LLC_MISSES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            default:
+                // FP_ARITH_INST_RETIRED, double: scalar | 128 | 256 | 512 bit (Intel, Skylake on)
+                attr.type = PERF_TYPE_RAW;
+                attr.config = 0x55c7;
+                return isIntel();
+        }
+        return true;
+    }
+
+    /* One counter group bound to one thread
+    *       the leader is the first event that opens, the others join it, so
+    *       all of them count over the same interval
+    */
+    class Group {
+    public:
+        Group() : leader(-1) {
+            for (int e = 0; e < EVENTS; ++e) {
+                fd[e] = -1;
+            }
+        }
+
+        ~Group() {
+            close();
+        }
+
+        Group(const Group &) = delete;
+        Group &operator=(const Group &) = delete;
+
+        // tid 0 is the calling thread, false if no event could be opened
+        bool open(const pid_t tid, const bool enabled) {
+            close();
+            for (int e = 0; e < EVENTS; ++e) {
+                perf_event_attr attr;
+                if (!describe(e, attr)) {
+                    continue;
+                }
+                attr.disabled = leader < 0 && !enabled;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID
+                        | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                fd[e] = (int) syscall(__NR_perf_event_open, &attr, tid, -1, leader, 0);
+                if (fd[e] < 0) {
+                    continue;
+                }
+                ioctl(fd[e], PERF_EVENT_IOC_ID, &id[e]);
+                if (leader < 0) {
+                    leader = fd[e];
+                }
+            }
+            return leader >= 0;
+        }
+
+        void close() {
+            for (int e = 0; e < EVENTS; ++e) {
+                if (fd[e] >= 0) {
+                    ::close(fd[e]);
+                }
+                fd[e] = -1;
+            }
+            leader = -1;
+        }
+
+        void reset() {
+            if (leader >= 0) {
+                ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            }
+        }
+
+        void enable() {
+            if (leader >= 0) {
+                ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
+
+        void disable() {
+            if (leader >= 0) {
+                ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
+
+        // scaled up when the kernel had to multiplex the group
+        Counts read() const {
+            Counts counts;
+            if (leader < 0) {
+                return counts;
+            }
+            uint64_t buffer[3 + 2 * EVENTS];
+            if (::read(leader, buffer, sizeof(buffer)) < (ssize_t) (3 * sizeof(uint64_t))) {
+                return counts;
+            }
+            const uint64_t events = buffer[0], enabled = buffer[1], running = buffer[2];
+            const double scale = running > 0 && running < enabled ? (double) enabled / running : 1.0;
+            for (uint64_t i = 0; i < events && i < EVENTS; ++i) {
+                const uint64_t value = buffer[3 + 2 * i], eventId = buffer[4 + 2 * i];
+                for (int e = 0; e < EVENTS; ++e) {
+                    if (fd[e] >= 0 && id[e] == eventId) {
+                        counts.value[e] = (uint64_t) (value * scale);
+                        counts.valid[e] = true;
+                    }
+                }
+            }
+            return counts;
+        }
+
+    private:
+        int leader;
+        int fd[EVENTS];
+        uint64_t id[EVENTS];
+    };
+
+    // every thread of the process, counted together
+    class ProcessCounters {
+    public:
+        ProcessCounters() {
+            DIR *tasks = opendir("/proc/self/task");
+            if (tasks == NULL) {
+                return;
+            }
+            while (dirent *entry = readdir(tasks)) {
+                const pid_t tid = (pid_t) atoi(entry->d_name);
+                if (tid <= 0) {
+                    continue;
+                }
+                Group *group = new Group();
+                if (group->open(tid, false)) {
+                    groups.push_back(group);
+                } else {
+                    delete group;
+                }
+            }
+            closedir(tasks);
+        }
+
+        ~ProcessCounters() {
+            for (size_t i = 0; i < groups.size(); ++i) {
+                delete groups[i];
+            }
+        }
+
+        ProcessCounters(const ProcessCounters &) = delete;
+        ProcessCounters &operator=(const ProcessCounters &) = delete;
+
+        bool available() const {
+            return !groups.empty();
+        }
+
+        void start() {
+            for (size_t i = 0; i < groups.size(); ++i) {
+                groups[i]->reset();
+                groups[i]->enable();
+            }
+        }
+
+        Counts stop() {
+            Counts total;
+            for (size_t i = 0; i < groups.size(); ++i) {
+                groups[i]->disable();
+                total += groups[i]->read();
+            }
+            return total;
+        }
+
+    private:
+        std::vector<Group *> groups;
+    };
+
+    const int MAX_LEVELS = 32;
+
+    struct Level {
+        Counts counts;
+        uint64_t calls;
+    };
+
+    static Level levels[MAX_LEVELS];
+    static std::mutex levelsLock;
+
+    void resetLevels() {
+        std::lock_guard<std::mutex> guard(levelsLock);
+        for (int l = 0; l < MAX_LEVELS; ++l) {
+            levels[l] = Level();
+        }
+    }
+
+    // levels 0 .. deepest one seen since resetLevels()
+    std::vector<Level> collectLevels() {
+        std::lock_guard<std::mutex> guard(levelsLock);
+        int used = MAX_LEVELS;
+        while (used > 0 && levels[used - 1].calls == 0) {
+            used--;
+        }
+        return std::vector<Level>(levels, levels + used);
+    }
+
+    // always counting, opened on the first scope a thread enters
+    static Group &threadGroup() {
+        thread_local Group group;
+        thread_local bool opened = false;
+        if (!opened) {
+            group.open(0, true);
+            opened = true;
+        }
+        return group;
+    }
+
+    struct Frame {
+        int taskDepth;
+        int level;
+        Counts start;
+        Counts nested;
+    };
+
+    thread_local std::vector<Frame> frames;
+
+    /* Recursion level of the scope
+    *       one below the enclosing scope of the same pool task, otherwise the
+    *       depth of the task itself: the parallel engines spawn one task
+    *       level per recursion level, and a task helped out inside
+    *       TaskGroup::wait() still lands on its own level
+    */
+    class LevelScope {
+    public:
+        LevelScope() {
+            Frame frame;
+            frame.taskDepth = scheduler::currentDepth;
+            if (!frames.empty() && frames.back().taskDepth == frame.taskDepth) {
+                frame.level = frames.back().level + 1;
+            } else {
+                frame.level = frame.taskDepth > 0 ? frame.taskDepth : 0;
+            }
+            frames.push_back(frame);
+            frames.back().start = threadGroup().read();
+        }
+
+        ~LevelScope() {
+            const Counts inclusive = threadGroup().read() - frames.back().start;
+            const Frame frame = frames.back();
+            frames.pop_back();
+            if (!frames.empty()) {
+                frames.back().nested += inclusive;
+            }
+            if (frame.level < MAX_LEVELS) {
+                std::lock_guard<std::mutex> guard(levelsLock);
+                levels[frame.level].counts += inclusive - frame.nested;
+                levels[frame.level].calls++;
+            }
+        }
+
+        LevelScope(const LevelScope &) = delete;
+        LevelScope &operator=(const LevelScope &) = delete;
+    };
+}
+
+#define PERF_LEVEL_SCOPE() perf::LevelScope perfLevelScope
+
+#else
+
+#define PERF_LEVEL_SCOPE()
+
+#endif
+
+#endif
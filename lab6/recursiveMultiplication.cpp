@@ -1,14 +1,61 @@
 #include <iostream>
-#include <conio.h>
 #include "utils.h"
+#include "matrix.h"
+#include "gemmKernel.h"
+#include "arena.h"
+#include "scheduler.h"
+#include "perfCounters.h"
 
 /* Cormen, Leiserson, Rivest, Stein. Introduction to Algorithms, 2nd Ed.
 * Chapter 28.  Matrix Operations
 *       28.2 Strassen's algorithm for createMatrix multiplication
 * Recursive Algorithms for Matrix Multiplication
 *       result = first * second
+*   result is m x n, first is m x k, second is k x n, any sizes: every
+*   dimension is split into halves x / 2 and x - x / 2, so odd sizes just give
+*   quadrants that differ by one row / column instead of padding.
+*   Temporaries come from per-thread arenas sized up front for the deepest
+*   chain of nested calls. The parallel version runs on the work-stealing
+*   pool (scheduler.h), which only nests deeper tasks on a thread, so every
+*   arena is still used in LIFO order; arenas[worker] belongs to that worker.
 */
 namespace recursive {
+    // below this size the blocked kernel is faster than splitting further
+    int cutoff = 64;
+    // below this size a subproblem is not worth a task of its own
+    int grain = 128;
+
+    // arena bytes one thread needs for the deepest chain of nested calls
+    template <typename T>
+    size_t arrayWorkspaceBytes(const int m, const int k, const int n) {
+        if (m <= cutoff || k <= cutoff || n <= cutoff) {
+            return 0;
+        }
+        const int m1 = m / 2, m2 = m - m1;
+        const int k1 = k / 2, k2 = k - k1;
+        const int n1 = n / 2, n2 = n - n1;
+        const size_t level = arenaArrayBytes<T>(m1, k1) + arenaArrayBytes<T>(m1, k2)
+                + arenaArrayBytes<T>(m2, k1) + arenaArrayBytes<T>(m2, k2)
+                + arenaArrayBytes<T>(k1, n1) + arenaArrayBytes<T>(k1, n2)
+                + arenaArrayBytes<T>(k2, n1) + arenaArrayBytes<T>(k2, n2)
+                + 2 * (arenaArrayBytes<T>(m1, n1) + arenaArrayBytes<T>(m1, n2)
+                + arenaArrayBytes<T>(m2, n1) + arenaArrayBytes<T>(m2, n2));
+        return level + arrayWorkspaceBytes<T>(m2, k2, n2);
+    }
+
+    template <typename T>
+    size_t matrixWorkspaceBytes(const int m, const int k, const int n) {
+        if (m <= cutoff || k <= cutoff || n <= cutoff) {
+            return 0;
+        }
+        const int m1 = m / 2, m2 = m - m1;
+        const int k2 = k - k / 2;
+        const int n1 = n / 2, n2 = n - n1;
+        const size_t level = 2 * (arenaMatrixBytes<T>(m1, n1) + arenaMatrixBytes<T>(m1, n2)
+                + arenaMatrixBytes<T>(m2, n1) + arenaMatrixBytes<T>(m2, n2));
+        return level + matrixWorkspaceBytes<T>(m2, k2, n2);
+    }
+
     /****************************************************************************/
     /*      result      =     first     *    second                             */
     /*                                                                          */
@@ -20,231 +67,386 @@ namespace recursive {
     /*   s = af + bh                             |                              */
     /*   t = ce + dg                             |                              */
     /*   u = cf + dh                             | i                            */
+    /*                                                                          */
+    /*   a, r: m1 x k1 / m1 x n1      e: k1 x n1      m1 = m / 2, m2 = m - m1   */
+    /*   d, u: m2 x k2 / m2 x n2      h: k2 x n2      (same for k and n)        */
     /****************************************************************************/
-    void multParallel(double **result, double **first, double **second, int size) {
-        if (size == 2) {
-            double a, b, e, f, c, d, g, h;
-
-            a = first[0][0];
-            b = first[0][1];
-            c = first[1][0];
-            d = first[1][1];
-
-            e = second[0][0];
-            f = second[0][1];
-            g = second[1][0];
-            h = second[1][1];
-
-            result[0][0] = a*e + b*g;   // r = ae + bg
-            result[0][1] = a*f + b*h;   // s = af + bh
-            result[1][0] = c*e + d*g;   // t = ce + dg
-            result[1][1] = c*f + d*h;   // u = cf + dh
+    template <typename T>
+    void multSerial(T **result, T **first, T **second,
+            const int m, const int k, const int n, Arena &arena) {
+        PERF_LEVEL_SCOPE();
+        if (m <= cutoff || k <= cutoff || n <= cutoff) {
+            kernel::clear(result, 0, 0, m, n);
+            kernel::multiplyAdd(result, 0, 0, first, 0, 0, second, 0, 0, m, n, k);
         } else {
             int i, j;
-            double **a, **b, **e, **f, **ae, **bg, **af, **bh;
-            double **c, **d, **g, **h, **ce, **dg, **cf, **dh;
+            T **a, **b, **e, **f, **ae, **bg, **af, **bh;
+            T **c, **d, **g, **h, **ce, **dg, **cf, **dh;
 
-            size >>= 1;
+            const int m1 = m / 2, m2 = m - m1;
+            const int k1 = k / 2, k2 = k - k1;
+            const int n1 = n / 2, n2 = n - n1;
+            const size_t top = arena.mark();
             // create subMatrix
-            a = createMatrix(size, size);
-            b = createMatrix(size, size);
-            c = createMatrix(size, size);
-            d = createMatrix(size, size);
-
-            e = createMatrix(size, size);
-            f = createMatrix(size, size);
-            g = createMatrix(size, size);
-            h = createMatrix(size, size);
-
-            ae = createMatrix(size, size);
-            bg = createMatrix(size, size);
-            af = createMatrix(size, size);
-            bh = createMatrix(size, size);
-
-            ce = createMatrix(size, size);
-            dg = createMatrix(size, size);
-            cf = createMatrix(size, size);
-            dh = createMatrix(size, size);
+            a = createMatrix<T>(arena, m1, k1);
+            b = createMatrix<T>(arena, m1, k2);
+            c = createMatrix<T>(arena, m2, k1);
+            d = createMatrix<T>(arena, m2, k2);
+
+            e = createMatrix<T>(arena, k1, n1);
+            f = createMatrix<T>(arena, k1, n2);
+            g = createMatrix<T>(arena, k2, n1);
+            h = createMatrix<T>(arena, k2, n2);
+
+            ae = createMatrix<T>(arena, m1, n1);
+            bg = createMatrix<T>(arena, m1, n1);
+            af = createMatrix<T>(arena, m1, n2);
+            bh = createMatrix<T>(arena, m1, n2);
+
+            ce = createMatrix<T>(arena, m2, n1);
+            dg = createMatrix<T>(arena, m2, n1);
+            cf = createMatrix<T>(arena, m2, n2);
+            dh = createMatrix<T>(arena, m2, n2);
 
             // initialize subMatrix
-            #pragma omp parallel for
-            for (i=0; i < size; i++) {
-                for (j = 0; j < size; j++) {
+            for (i = 0; i < m1; i++) {
+                for (j = 0; j < k1; j++) {
                     a[i][j] = first[i][j];                  // first
-                    b[i][j] = first[i][j + size];           //   | a  b |
-                    c[i][j] = first[i + size][j];           //   |      |
-                    d[i][j] = first[i + size][j + size];    //   | c  d |
-
+                }                                           //   | a  b |
+                for (j = 0; j < k2; j++) {                  //   |      |
+                    b[i][j] = first[i][j + k1];             //   | c  d |
+                }
+            }
+            for (i = 0; i < m2; i++) {
+                for (j = 0; j < k1; j++) {
+                    c[i][j] = first[i + m1][j];
+                }
+                for (j = 0; j < k2; j++) {
+                    d[i][j] = first[i + m1][j + k1];
+                }
+            }
+            for (i = 0; i < k1; i++) {
+                for (j = 0; j < n1; j++) {
                     e[i][j] = second[i][j];                 // second
-                    f[i][j] = second[i][j + size];          //   | e  f |
-                    g[i][j] = second[i + size][j];          //   |      |
-                    h[i][j] = second[i + size][j + size];   //   | g  h |
+                }                                           //   | e  f |
+                for (j = 0; j < n2; j++) {                  //   |      |
+                    f[i][j] = second[i][j + n1];            //   | g  h |
+                }
+            }
+            for (i = 0; i < k2; i++) {
+                for (j = 0; j < n1; j++) {
+                    g[i][j] = second[i + k1][j];
+                }
+                for (j = 0; j < n2; j++) {
+                    h[i][j] = second[i + k1][j + n1];
                 }
             }
-            #pragma omp wait
-
-            #pragma omp task firstprivate(ae, a, e, size)
-            multParallel(ae, a, e, size);   // ae = a x e
-            #pragma omp task firstprivate(bg, b, g, size)
-            multParallel(bg, b, g, size);   // bg = b x g
 
-            #pragma omp task firstprivate(af, a, f, size)
-            multParallel(af, a, f, size);   // af = a x f
-            #pragma omp task firstprivate(bh, b, h, size)
-            multParallel(bh, b, h, size);   // bh = b x h
+            multSerial(ae, a, e, m1, k1, n1, arena);      // ae = a x e
+            multSerial(bg, b, g, m1, k2, n1, arena);      // bg = b x g
 
-            #pragma omp task firstprivate(ce, c, e, size)
-            multParallel(ce, c, e, size);   // ce = c x e
-            #pragma omp task firstprivate(dg, d, g, size)
-            multParallel(dg, d, g, size);   // dg = d x g
+            multSerial(af, a, f, m1, k1, n2, arena);      // af = a x f
+            multSerial(bh, b, h, m1, k2, n2, arena);      // bh = b x h
 
-            #pragma omp task firstprivate(cf, c, f, size)
-            multParallel(cf, c, f, size);   // cf = c x f
-            #pragma omp task firstprivate(dh, d, h, size)
-            multParallel(dh, d, h, size);   // dh = d x h
+            multSerial(ce, c, e, m2, k1, n1, arena);      // ce = c x e
+            multSerial(dg, d, g, m2, k2, n1, arena);      // dg = d x g
 
-            #pragma omp taskwait
+            multSerial(cf, c, f, m2, k1, n2, arena);      // cf = c x f
+            multSerial(dh, d, h, m2, k2, n2, arena);      // dh = d x h
 
-            #pragma omp parallel for
-            for (i=0; i < size; i++) {
-                for (j = 0; j < size; j++) {
-                    result[i][j]                = ae[i][j] + bg[i][j];  // r = ae + bg
-                    result[i][j + size]         = af[i][j] + bh[i][j];  // s = af + bh
-                    result[i + size][j]         = ce[i][j] + dg[i][j];  // t = ce + dg
-                    result[i + size][j + size]  = cf[i][j] + dh[i][j];  // u = cf + dh
+            for (i = 0; i < m1; i++) {
+                for (j = 0; j < n1; j++) {
+                    result[i][j]            = ae[i][j] + bg[i][j];  // r = ae + bg
+                }
+                for (j = 0; j < n2; j++) {
+                    result[i][j + n1]       = af[i][j] + bh[i][j];  // s = af + bh
+                }
+            }
+            for (i = 0; i < m2; i++) {
+                for (j = 0; j < n1; j++) {
+                    result[i + m1][j]       = ce[i][j] + dg[i][j];  // t = ce + dg
+                }
+                for (j = 0; j < n2; j++) {
+                    result[i + m1][j + n1]  = cf[i][j] + dh[i][j];  // u = cf + dh
                 }
             }
 
-            freeMatrix(a);
-            freeMatrix(b);
-            freeMatrix(c);
-            freeMatrix(d);
-
-            freeMatrix(e);
-            freeMatrix(f);
-            freeMatrix(g);
-            freeMatrix(h);
-
-            freeMatrix(ae);
-            freeMatrix(bg);
-            freeMatrix(af);
-            freeMatrix(bh);
-
-            freeMatrix(ce);
-            freeMatrix(dg);
-            freeMatrix(cf);
-            freeMatrix(dh);
-        }
-    }
-
-    void multiplyParallel(double **result, double **first, double **second, int size) {
-        #pragma omp parallel
-        {
-            #pragma omp single nowait
-            multParallel(result, first, second, size);
+            arena.release(top);
         }
     }
 
-    void multiplySerial(double **result, double **first, double **second, int size) {
-        if (size == 2) {
-            double a, b, e, f, c, d, g, h;
-
-            a = first[0][0];
-            b = first[0][1];
-            c = first[1][0];
-            d = first[1][1];
-
-            e = second[0][0];
-            f = second[0][1];
-            g = second[1][0];
-            h = second[1][1];
-
-            result[0][0] = a*e + b*g;   // r = ae + bg
-            result[0][1] = a*f + b*h;   // s = af + bh
-            result[1][0] = c*e + d*g;   // t = ce + dg
-            result[1][1] = c*f + d*h;   // u = cf + dh
+    template <typename T>
+    void multParallel(T **result, T **first, T **second,
+            const int m, const int k, const int n, Arena *arenas) {
+        scheduler::WorkStealingPool &pool = scheduler::pool();
+        Arena &arena = arenas[pool.workerId()];
+        if (m <= grain || k <= grain || n <= grain) {
+            multSerial(result, first, second, m, k, n, arena);
         } else {
+            PERF_LEVEL_SCOPE();
             int i, j;
-            double **a, **b, **e, **f, **ae, **bg, **af, **bh;
-            double **c, **d, **g, **h, **ce, **dg, **cf, **dh;
+            T **a, **b, **e, **f, **ae, **bg, **af, **bh;
+            T **c, **d, **g, **h, **ce, **dg, **cf, **dh;
 
-            size >>= 1;
+            const int m1 = m / 2, m2 = m - m1;
+            const int k1 = k / 2, k2 = k - k1;
+            const int n1 = n / 2, n2 = n - n1;
+            const size_t top = arena.mark();
             // create subMatrix
-            a = createMatrix(size, size);
-            b = createMatrix(size, size);
-            c = createMatrix(size, size);
-            d = createMatrix(size, size);
-
-            e = createMatrix(size, size);
-            f = createMatrix(size, size);
-            g = createMatrix(size, size);
-            h = createMatrix(size, size);
-
-            ae = createMatrix(size, size);
-            bg = createMatrix(size, size);
-            af = createMatrix(size, size);
-            bh = createMatrix(size, size);
-
-            ce = createMatrix(size, size);
-            dg = createMatrix(size, size);
-            cf = createMatrix(size, size);
-            dh = createMatrix(size, size);
+            a = createMatrix<T>(arena, m1, k1);
+            b = createMatrix<T>(arena, m1, k2);
+            c = createMatrix<T>(arena, m2, k1);
+            d = createMatrix<T>(arena, m2, k2);
+
+            e = createMatrix<T>(arena, k1, n1);
+            f = createMatrix<T>(arena, k1, n2);
+            g = createMatrix<T>(arena, k2, n1);
+            h = createMatrix<T>(arena, k2, n2);
+
+            ae = createMatrix<T>(arena, m1, n1);
+            bg = createMatrix<T>(arena, m1, n1);
+            af = createMatrix<T>(arena, m1, n2);
+            bh = createMatrix<T>(arena, m1, n2);
+
+            ce = createMatrix<T>(arena, m2, n1);
+            dg = createMatrix<T>(arena, m2, n1);
+            cf = createMatrix<T>(arena, m2, n2);
+            dh = createMatrix<T>(arena, m2, n2);
 
             // initialize subMatrix
-            for (i=0; i < size; i++) {
-                for (j = 0; j < size; j++) {
+            for (i = 0; i < m1; i++) {
+                for (j = 0; j < k1; j++) {
                     a[i][j] = first[i][j];                  // first
-                    b[i][j] = first[i][j + size];           //   | a  b |
-                    c[i][j] = first[i + size][j];           //   |      |
-                    d[i][j] = first[i + size][j + size];    //   | c  d |
-
+                }                                           //   | a  b |
+                for (j = 0; j < k2; j++) {                  //   |      |
+                    b[i][j] = first[i][j + k1];             //   | c  d |
+                }
+            }
+            for (i = 0; i < m2; i++) {
+                for (j = 0; j < k1; j++) {
+                    c[i][j] = first[i + m1][j];
+                }
+                for (j = 0; j < k2; j++) {
+                    d[i][j] = first[i + m1][j + k1];
+                }
+            }
+            for (i = 0; i < k1; i++) {
+                for (j = 0; j < n1; j++) {
                     e[i][j] = second[i][j];                 // second
-                    f[i][j] = second[i][j + size];          //   | e  f |
-                    g[i][j] = second[i + size][j];          //   |      |
-                    h[i][j] = second[i + size][j + size];   //   | g  h |
+                }                                           //   | e  f |
+                for (j = 0; j < n2; j++) {                  //   |      |
+                    f[i][j] = second[i][j + n1];            //   | g  h |
+                }
+            }
+            for (i = 0; i < k2; i++) {
+                for (j = 0; j < n1; j++) {
+                    g[i][j] = second[i + k1][j];
+                }
+                for (j = 0; j < n2; j++) {
+                    h[i][j] = second[i + k1][j + n1];
                 }
             }
 
-            multiplySerial(ae, a, e, size);   // ae = a x e
-            multiplySerial(bg, b, g, size);   // bg = b x g
+            scheduler::TaskGroup group(pool);
+            group.spawn([=]() { multParallel(ae, a, e, m1, k1, n1, arenas); });         // ae = a x e
+            group.spawn([=]() { multParallel(bg, b, g, m1, k2, n1, arenas); });         // bg = b x g
 
-            multiplySerial(af, a, f, size);   // af = a x f
-            multiplySerial(bh, b, h, size);   // bh = b x h
+            group.spawn([=]() { multParallel(af, a, f, m1, k1, n2, arenas); });         // af = a x f
+            group.spawn([=]() { multParallel(bh, b, h, m1, k2, n2, arenas); });         // bh = b x h
 
-            multiplySerial(ce, c, e, size);   // ce = c x e
-            multiplySerial(dg, d, g, size);   // dg = d x g
+            group.spawn([=]() { multParallel(ce, c, e, m2, k1, n1, arenas); });         // ce = c x e
+            group.spawn([=]() { multParallel(dg, d, g, m2, k2, n1, arenas); });         // dg = d x g
 
-            multiplySerial(cf, c, f, size);   // cf = c x f
-            multiplySerial(dh, d, h, size);   // dh = d x h
+            group.spawn([=]() { multParallel(cf, c, f, m2, k1, n2, arenas); });         // cf = c x f
+            group.spawn([=]() { multParallel(dh, d, h, m2, k2, n2, arenas); });         // dh = d x h
+            group.wait();
 
-            for (i=0; i < size; i++) {
-                for (j = 0; j < size; j++) {
-                    result[i][j]                = ae[i][j] + bg[i][j];  // r = ae + bg
-                    result[i][j + size]         = af[i][j] + bh[i][j];  // s = af + bh
-                    result[i + size][j]         = ce[i][j] + dg[i][j];  // t = ce + dg
-                    result[i + size][j + size]  = cf[i][j] + dh[i][j];  // u = cf + dh
+            for (i = 0; i < m1; i++) {
+                for (j = 0; j < n1; j++) {
+                    result[i][j]            = ae[i][j] + bg[i][j];  // r = ae + bg
+                }
+                for (j = 0; j < n2; j++) {
+                    result[i][j + n1]       = af[i][j] + bh[i][j];  // s = af + bh
+                }
+            }
+            for (i = 0; i < m2; i++) {
+                for (j = 0; j < n1; j++) {
+                    result[i + m1][j]       = ce[i][j] + dg[i][j];  // t = ce + dg
+                }
+                for (j = 0; j < n2; j++) {
+                    result[i + m1][j + n1]  = cf[i][j] + dh[i][j];  // u = cf + dh
                 }
             }
 
-            freeMatrix(a);
-            freeMatrix(b);
-            freeMatrix(c);
-            freeMatrix(d);
+            arena.release(top);
+        }
+    }
 
-            freeMatrix(e);
-            freeMatrix(f);
-            freeMatrix(g);
-            freeMatrix(h);
+    template <typename T>
+    void multiplyParallel(T **result, T **first, T **second, const int m, const int k, const int n) {
+        scheduler::WorkStealingPool &pool = scheduler::pool();
+        Arena *arenas = new Arena[pool.size()];
+        for (int t = 0; t < pool.size(); ++t) {
+            arenas[t].reserve(arrayWorkspaceBytes<T>(m, k, n));
+        }
+        pool.run([&]() { multParallel(result, first, second, m, k, n, arenas); });
+        delete[] arenas;
+    }
 
-            freeMatrix(ae);
-            freeMatrix(bg);
-            freeMatrix(af);
-            freeMatrix(bh);
+    template <typename T>
+    void multiplyParallel(T **result, T **first, T **second, const int size) {
+        multiplyParallel(result, first, second, size, size, size);
+    }
+
+    template <typename T>
+    void multiplySerial(T **result, T **first, T **second, const int m, const int k, const int n) {
+        Arena arena(arrayWorkspaceBytes<T>(m, k, n));
+        multSerial(result, first, second, m, k, n, arena);
+    }
+
+    template <typename T>
+    void multiplySerial(T **result, T **first, T **second, const int size) {
+        multiplySerial(result, first, second, size, size, size);
+    }
 
-            freeMatrix(ce);
-            freeMatrix(dg);
-            freeMatrix(cf);
-            freeMatrix(dh);
+    /* Matrix overloads
+    *       a..h are views into first / second, so the operand quadrants are no
+    *       longer copied, only the eight products take arena space
+    */
+    template <typename T>
+    void multSerial(const BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second, Arena &arena) {
+        PERF_LEVEL_SCOPE();
+        const int m = result.rows, k = first.cols, n = result.cols;
+        if (m <= cutoff || k <= cutoff || n <= cutoff) {
+            kernel::multiply(result, first, second);
+        } else {
+            const int m1 = m / 2, m2 = m - m1;
+            const int k1 = k / 2, k2 = k - k1;
+            const int n1 = n / 2, n2 = n - n1;
+            BasicMatrix<T> a = first.view(0, 0, m1, k1);            // first
+            BasicMatrix<T> b = first.view(0, k1, m1, k2);           //   | a  b |
+            BasicMatrix<T> c = first.view(m1, 0, m2, k1);           //   |      |
+            BasicMatrix<T> d = first.view(m1, k1, m2, k2);          //   | c  d |
+
+            BasicMatrix<T> e = second.view(0, 0, k1, n1);           // second
+            BasicMatrix<T> f = second.view(0, n1, k1, n2);          //   | e  f |
+            BasicMatrix<T> g = second.view(k1, 0, k2, n1);          //   |      |
+            BasicMatrix<T> h = second.view(k1, n1, k2, n2);         //   | g  h |
+
+            const size_t top = arena.mark();
+            BasicMatrix<T> ae = arenaMatrix<T>(arena, m1, n1), bg = arenaMatrix<T>(arena, m1, n1);
+            BasicMatrix<T> af = arenaMatrix<T>(arena, m1, n2), bh = arenaMatrix<T>(arena, m1, n2);
+            BasicMatrix<T> ce = arenaMatrix<T>(arena, m2, n1), dg = arenaMatrix<T>(arena, m2, n1);
+            BasicMatrix<T> cf = arenaMatrix<T>(arena, m2, n2), dh = arenaMatrix<T>(arena, m2, n2);
+
+            multSerial(ae, a, e, arena);        // ae = a x e
+            multSerial(bg, b, g, arena);        // bg = b x g
+
+            multSerial(af, a, f, arena);        // af = a x f
+            multSerial(bh, b, h, arena);        // bh = b x h
+
+            multSerial(ce, c, e, arena);        // ce = c x e
+            multSerial(dg, d, g, arena);        // dg = d x g
+
+            multSerial(cf, c, f, arena);        // cf = c x f
+            multSerial(dh, d, h, arena);        // dh = d x h
+
+            for (int i = 0; i < m1; i++) {
+                for (int j = 0; j < n1; j++) {
+                    result[i][j]            = ae[i][j] + bg[i][j];  // r = ae + bg
+                }
+                for (int j = 0; j < n2; j++) {
+                    result[i][j + n1]       = af[i][j] + bh[i][j];  // s = af + bh
+                }
+            }
+            for (int i = 0; i < m2; i++) {
+                for (int j = 0; j < n1; j++) {
+                    result[i + m1][j]       = ce[i][j] + dg[i][j];  // t = ce + dg
+                }
+                for (int j = 0; j < n2; j++) {
+                    result[i + m1][j + n1]  = cf[i][j] + dh[i][j];  // u = cf + dh
+                }
+            }
+            arena.release(top);
+        }
+    }
+
+    template <typename T>
+    void multParallel(const BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second, Arena *arenas) {
+        const int m = result.rows, k = first.cols, n = result.cols;
+        scheduler::WorkStealingPool &pool = scheduler::pool();
+        Arena &arena = arenas[pool.workerId()];
+        if (m <= grain || k <= grain || n <= grain) {
+            multSerial(result, first, second, arena);
+        } else {
+            PERF_LEVEL_SCOPE();
+            const int m1 = m / 2, m2 = m - m1;
+            const int k1 = k / 2, k2 = k - k1;
+            const int n1 = n / 2, n2 = n - n1;
+            BasicMatrix<T> a = first.view(0, 0, m1, k1);            // first
+            BasicMatrix<T> b = first.view(0, k1, m1, k2);           //   | a  b |
+            BasicMatrix<T> c = first.view(m1, 0, m2, k1);           //   |      |
+            BasicMatrix<T> d = first.view(m1, k1, m2, k2);          //   | c  d |
+
+            BasicMatrix<T> e = second.view(0, 0, k1, n1);           // second
+            BasicMatrix<T> f = second.view(0, n1, k1, n2);          //   | e  f |
+            BasicMatrix<T> g = second.view(k1, 0, k2, n1);          //   |      |
+            BasicMatrix<T> h = second.view(k1, n1, k2, n2);         //   | g  h |
+
+            const size_t top = arena.mark();
+            BasicMatrix<T> ae = arenaMatrix<T>(arena, m1, n1), bg = arenaMatrix<T>(arena, m1, n1);
+            BasicMatrix<T> af = arenaMatrix<T>(arena, m1, n2), bh = arenaMatrix<T>(arena, m1, n2);
+            BasicMatrix<T> ce = arenaMatrix<T>(arena, m2, n1), dg = arenaMatrix<T>(arena, m2, n1);
+            BasicMatrix<T> cf = arenaMatrix<T>(arena, m2, n2), dh = arenaMatrix<T>(arena, m2, n2);
+
+            scheduler::TaskGroup group(pool);
+            group.spawn([&]() { multParallel(ae, a, e, arenas); });           // ae = a x e
+            group.spawn([&]() { multParallel(bg, b, g, arenas); });           // bg = b x g
+
+            group.spawn([&]() { multParallel(af, a, f, arenas); });           // af = a x f
+            group.spawn([&]() { multParallel(bh, b, h, arenas); });           // bh = b x h
+
+            group.spawn([&]() { multParallel(ce, c, e, arenas); });           // ce = c x e
+            group.spawn([&]() { multParallel(dg, d, g, arenas); });           // dg = d x g
+
+            group.spawn([&]() { multParallel(cf, c, f, arenas); });           // cf = c x f
+            group.spawn([&]() { multParallel(dh, d, h, arenas); });           // dh = d x h
+            group.wait();
+
+            for (int i = 0; i < m1; i++) {
+                for (int j = 0; j < n1; j++) {
+                    result[i][j]            = ae[i][j] + bg[i][j];  // r = ae + bg
+                }
+                for (int j = 0; j < n2; j++) {
+                    result[i][j + n1]       = af[i][j] + bh[i][j];  // s = af + bh
+                }
+            }
+            for (int i = 0; i < m2; i++) {
+                for (int j = 0; j < n1; j++) {
+                    result[i + m1][j]       = ce[i][j] + dg[i][j];  // t = ce + dg
+                }
+                for (int j = 0; j < n2; j++) {
+                    result[i + m1][j + n1]  = cf[i][j] + dh[i][j];  // u = cf + dh
+                }
+            }
+            arena.release(top);
         }
     }
+
+    template <typename T>
+    void multiplyParallel(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        scheduler::WorkStealingPool &pool = scheduler::pool();
+        Arena *arenas = new Arena[pool.size()];
+        for (int t = 0; t < pool.size(); ++t) {
+            arenas[t].reserve(matrixWorkspaceBytes<T>(result.rows, first.cols, result.cols));
+        }
+        pool.run([&]() { multParallel(result, first, second, arenas); });
+        delete[] arenas;
+    }
+
+    template <typename T>
+    void multiplySerial(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        Arena arena(matrixWorkspaceBytes<T>(result.rows, first.cols, result.cols));
+        multSerial(result, first, second, arena);
+    }
 }
\ No newline at end of file
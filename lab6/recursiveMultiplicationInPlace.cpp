@@ -1,13 +1,35 @@
+#ifndef RECURSIVE_MULTIPLICATION_IN_PLACE_CPP
+#define RECURSIVE_MULTIPLICATION_IN_PLACE_CPP
+
 #include <iostream>
-#include <conio.h>
+#include <algorithm>
+#include "matrix.h"
+#include "mortonMatrix.h"
+#include "gemmKernel.h"
+#include "scheduler.h"
+#include "perfCounters.h"
 
 /* Cormen, Leiserson, Rivest, Stein. Introduction to Algorithms, 2nd Ed.
 * Chapter 28.  Matrix Operations
 *       28.2 Strassen's algorithm for createMatrix multiplication
 * Recursive (in place) Algorithms for Matrix Multiplication
 *       result = first * second
+*   result is m x n, first is m x k, second is k x n, any sizes: every
+*   dimension is split into halves x / 2 and x - x / 2 (see recursive).
+*   The parallel version runs one task per result quadrant on the
+*   work-stealing pool (scheduler.h); the two halves accumulated into a
+*   quadrant (ae and bg into r, ...) run one after the other inside that
+*   task, so no two tasks ever write the same element.
+*   On Morton (Z-order) operands, see mortonMatrix.h, every quadrant is a
+*   contiguous block, so the recursion touches contiguous memory at every
+*   level instead of striding across rows of the full matrix.
 */
 namespace recursiveInPlace {
+    // below this size the blocked kernel is faster than splitting further
+    int cutoff = 64;
+    // below this size a subproblem is not worth a task of its own
+    int grain = 128;
+
     /****************************************************************************/
     /*      result      =     first     *    second                             */
     /*                                                                          */
@@ -20,101 +42,291 @@ namespace recursiveInPlace {
     /*   t = ce + dg                             |                              */
     /*   u = cf + dh                             | i                            */
     /****************************************************************************/
-    void multParallel(double **result, double **first, double **second,
-            int iR, int jR, int iF, int jF, int iS, int jS, int size) {
-        if (size == 2) {
-            double a, b, e, f, c, d, g, h;
-
-            a = first[iF][jF];
-            b = first[iF][jF+1];
-            c = first[iF+1][jF];
-            d = first[iF+1][jF+1];
-
-            e = second[iS][jS];
-            f = second[iS][jS+1];
-            g = second[iS+1][jS];
-            h = second[iS+1][jS+1];
-
-
-            result[iR][jR] += a*e + b*g;        // r = ae + bg
-            result[iR][jR+1] += a*f + b*h;      // s = af + bh
-            result[iR+1][jR] += c*e + d*g;      // t = ce + dg
-            result[iR+1][jR+1] += c*f + d*h;    // u = cf + dh
+    template <typename T>
+    void multSerial(T **result, T **first, T **second,
+            int iR, int jR, int iF, int jF, int iS, int jS, const int m, const int k, const int n) {
+        PERF_LEVEL_SCOPE();
+        if (m <= cutoff || k <= cutoff || n <= cutoff) {
+            kernel::multiplyAdd(result, iR, jR, first, iF, jF, second, iS, jS, m, n, k);
+        } else {
+            const int m1 = m / 2, m2 = m - m1;
+            const int k1 = k / 2, k2 = k - k1;
+            const int n1 = n / 2, n2 = n - n1;
+            // r=a=e=[0][0] s=b=f=[0][half]
+            // t=c=g=[half][0] u=d=h=[half][half]
+            multSerial(result, first, second, iR, jR, iF, jF, iS, jS, m1, k1, n1);                    // r = ae +
+            multSerial(result, first, second, iR, jR, iF, jF+k1, iS+k1, jS, m1, k2, n1);              //        + bg
+
+            multSerial(result, first, second, iR, jR+n1, iF, jF, iS, jS+n1, m1, k1, n2);              // s = af +
+            multSerial(result, first, second, iR, jR+n1, iF, jF+k1, iS+k1, jS+n1, m1, k2, n2);        //        + bh
+
+            multSerial(result, first, second, iR+m1, jR, iF+m1, jF, iS, jS, m2, k1, n1);              // t = ce +
+            multSerial(result, first, second, iR+m1, jR, iF+m1, jF+k1, iS+k1, jS, m2, k2, n1);        //        + dg
+
+            multSerial(result, first, second, iR+m1, jR+n1, iF+m1, jF, iS, jS+n1, m2, k1, n2);        // u = cf +
+            multSerial(result, first, second, iR+m1, jR+n1, iF+m1, jF+k1, iS+k1, jS+n1, m2, k2, n2);  //        + dh
+        }
+    }
+
+    template <typename T>
+    void multParallel(T **result, T **first, T **second,
+            int iR, int jR, int iF, int jF, int iS, int jS, const int m, const int k, const int n) {
+        if (m <= grain || k <= grain || n <= grain) {
+            multSerial(result, first, second, iR, jR, iF, jF, iS, jS, m, k, n);
+        } else {
+            PERF_LEVEL_SCOPE();
+            const int m1 = m / 2, m2 = m - m1;
+            const int k1 = k / 2, k2 = k - k1;
+            const int n1 = n / 2, n2 = n - n1;
+            // r=a=e=[0][0] s=b=f=[0][half]
+            // t=c=g=[half][0] u=d=h=[half][half]
+            scheduler::TaskGroup group(scheduler::pool());
+            group.spawn([=]() {
+                multParallel(result, first, second, iR, jR, iF, jF, iS, jS, m1, k1, n1);                    // r = ae +
+                multParallel(result, first, second, iR, jR, iF, jF+k1, iS+k1, jS, m1, k2, n1);              //        + bg
+            });
+            group.spawn([=]() {
+                multParallel(result, first, second, iR, jR+n1, iF, jF, iS, jS+n1, m1, k1, n2);              // s = af +
+                multParallel(result, first, second, iR, jR+n1, iF, jF+k1, iS+k1, jS+n1, m1, k2, n2);        //        + bh
+            });
+            group.spawn([=]() {
+                multParallel(result, first, second, iR+m1, jR, iF+m1, jF, iS, jS, m2, k1, n1);              // t = ce +
+                multParallel(result, first, second, iR+m1, jR, iF+m1, jF+k1, iS+k1, jS, m2, k2, n1);        //        + dg
+            });
+            group.spawn([=]() {
+                multParallel(result, first, second, iR+m1, jR+n1, iF+m1, jF, iS, jS+n1, m2, k1, n2);        // u = cf +
+                multParallel(result, first, second, iR+m1, jR+n1, iF+m1, jF+k1, iS+k1, jS+n1, m2, k2, n2);  //        + dh
+            });
+            group.wait();
+        }
+    }
+
+    template <typename T>
+    void multiplyParallel(T **result, T **first, T **second, const int m, const int k, const int n) {
+        scheduler::pool().run([&]() { multParallel(result, first, second, 0, 0, 0, 0, 0, 0, m, k, n); });
+    }
+
+    template <typename T>
+    void multiplyParallel(T **result, T **first, T **second, const int size) {
+        multiplyParallel(result, first, second, size, size, size);
+    }
+
+    template <typename T>
+    void multiplySerial(T **result, T **first, T **second, const int m, const int k, const int n) {
+        multSerial(result, first, second, 0, 0, 0, 0, 0, 0, m, k, n);
+    }
+
+    template <typename T>
+    void multiplySerial(T **result, T **first, T **second, const int size) {
+        multiplySerial(result, first, second, size, size, size);
+    }
+
+    /* Matrix overloads
+    *       quadrants are views, so the (iR, jR, iF, jF, iS, jS) offsets of the
+    *       double** version are folded into the view base pointers
+    *       multSerial / multParallel accumulate (result += first * second),
+    *       multiplySerial / multiplyParallel clear result first
+    */
+    template <typename T>
+    void multSerial(const BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        PERF_LEVEL_SCOPE();
+        const int m = result.rows, k = first.cols, n = result.cols;
+        if (m <= cutoff || k <= cutoff || n <= cutoff) {
+            kernel::multiplyAdd(result, first, second);
+        } else {
+            const int m1 = m / 2, m2 = m - m1;
+            const int k1 = k / 2, k2 = k - k1;
+            const int n1 = n / 2, n2 = n - n1;
+            BasicMatrix<T> r = result.view(0, 0, m1, n1), s = result.view(0, n1, m1, n2);
+            BasicMatrix<T> t = result.view(m1, 0, m2, n1), u = result.view(m1, n1, m2, n2);
+            BasicMatrix<T> a = first.view(0, 0, m1, k1), b = first.view(0, k1, m1, k2);
+            BasicMatrix<T> c = first.view(m1, 0, m2, k1), d = first.view(m1, k1, m2, k2);
+            BasicMatrix<T> e = second.view(0, 0, k1, n1), f = second.view(0, n1, k1, n2);
+            BasicMatrix<T> g = second.view(k1, 0, k2, n1), h = second.view(k1, n1, k2, n2);
+
+            multSerial(r, a, e);    // r = ae +
+            multSerial(r, b, g);    //        + bg
+
+            multSerial(s, a, f);    // s = af +
+            multSerial(s, b, h);    //        + bh
+
+            multSerial(t, c, e);    // t = ce +
+            multSerial(t, d, g);    //        + dg
+
+            multSerial(u, c, f);    // u = cf +
+            multSerial(u, d, h);    //        + dh
+        }
+    }
+
+    template <typename T>
+    void multParallel(const BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        const int m = result.rows, k = first.cols, n = result.cols;
+        if (m <= grain || k <= grain || n <= grain) {
+            multSerial(result, first, second);
         } else {
-            size >>= 1;    // size = size div 2
-            // r=a=e=[0][0] s=b=f=[0][size]
-            // t=c=g=[size][0] u=d=h=[size][size]
-            #pragma omp task
-            multParallel(result, first, second, iR, jR, iF, jF, iS, jS, size);            // r = ae +
-            #pragma omp task
-            multParallel(result, first, second, iR, jR, iF, jF+size, iS+size, jS, size);  //        + bg
-
-            #pragma omp task
-            multParallel(result, first, second, iR, jR+size, iF, jF, iS, jS+size, size);            // s = af +
-            #pragma omp task
-            multParallel(result, first, second, iR, jR+size, iF, jF+size, iS+size, jS+size, size);  //        + bh
-
-            #pragma omp task
-            multParallel(result, first, second, iR+size, jR, iF+size, jF, iS, jS, size);            // t = ce +
-            #pragma omp task
-            multParallel(result, first, second, iR+size, jR, iF+size, jF+size, iS+size, jS, size);  //        + dg
-
-            #pragma omp task
-            multParallel(result, first, second, iR+size, jR+size, iF+size, jF, iS, jS+size, size);            // u = cf +
-            #pragma omp task
-            multParallel(result, first, second, iR+size, jR+size, iF+size, jF+size, iS+size, jS+size, size);  //        + dh
-
-            #pragma omp taskwait
+            PERF_LEVEL_SCOPE();
+            const int m1 = m / 2, m2 = m - m1;
+            const int k1 = k / 2, k2 = k - k1;
+            const int n1 = n / 2, n2 = n - n1;
+            BasicMatrix<T> r = result.view(0, 0, m1, n1), s = result.view(0, n1, m1, n2);
+            BasicMatrix<T> t = result.view(m1, 0, m2, n1), u = result.view(m1, n1, m2, n2);
+            BasicMatrix<T> a = first.view(0, 0, m1, k1), b = first.view(0, k1, m1, k2);
+            BasicMatrix<T> c = first.view(m1, 0, m2, k1), d = first.view(m1, k1, m2, k2);
+            BasicMatrix<T> e = second.view(0, 0, k1, n1), f = second.view(0, n1, k1, n2);
+            BasicMatrix<T> g = second.view(k1, 0, k2, n1), h = second.view(k1, n1, k2, n2);
+
+            scheduler::TaskGroup group(scheduler::pool());
+            group.spawn([&]() {
+                multParallel(r, a, e);    // r = ae +
+                multParallel(r, b, g);    //        + bg
+            });
+            group.spawn([&]() {
+                multParallel(s, a, f);    // s = af +
+                multParallel(s, b, h);    //        + bh
+            });
+            group.spawn([&]() {
+                multParallel(t, c, e);    // t = ce +
+                multParallel(t, d, g);    //        + dg
+            });
+            group.spawn([&]() {
+                multParallel(u, c, f);    // u = cf +
+                multParallel(u, d, h);    //        + dh
+            });
+            group.wait();
         }
     }
 
-    void multiplyParallel(double **result, double **first, double **second, int size) {
-        #pragma omp parallel
-        {
-            #pragma omp single nowait
-            multParallel(result, first, second, 0, 0, 0, 0, 0, 0, size);
+    template <typename T>
+    void multiplyParallel(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        result.fill(0);
+        scheduler::pool().run([&]() { multParallel(result, first, second); });
+    }
+
+    template <typename T>
+    void multiplySerial(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        result.fill(0);
+        multSerial(result, first, second);
+    }
+    /* Morton overloads
+    *       operands in Z order with the same levels; the quadrants r s t u of a
+    *       block are its four consecutive quarters, so the recursion only moves
+    *       pointers and every leaf is one tile lying in consecutive pages
+    *   The depth is fixed by the layout rather than checked against cutoff on
+    *   the way down. Every leaf has the same size, so mortonLevels() keeps the
+    *   smallest tile between 3/4 and 3/2 of cutoff instead of splitting 65
+    *   into tiles of 33 that are too small to feed the kernel.
+    */
+    int mortonLevels(const int m, const int k, const int n) {
+        int smallest = std::min(m, std::min(k, n));
+        int levels = 0;
+        while (2 * smallest > 3 * cutoff && levels < 15) {
+            smallest -= smallest / 2;
+            ++levels;
         }
+        return levels;
     }
 
-    void multSerial(double **result, double **first, double **second,
-            int iR, int jR, int iF, int jF, int iS, int jS, int size) {
-        if (size == 2) {
-            double a, b, e, f, c, d, g, h;
+    template <typename T>
+    void multSerial(T *r, const T *a, const T *b, const MortonMatrix<T> &result,
+            const MortonMatrix<T> &first, const MortonMatrix<T> &second, const int depth) {
+        PERF_LEVEL_SCOPE();
+        if (depth == result.levels) {
+            kernel::multiplyAdd(BasicMatrix<T>(r, result.tileRows, result.tileCols, result.tileStride),
+                    BasicMatrix<T>((T *) a, first.tileRows, first.tileCols, first.tileStride),
+                    BasicMatrix<T>((T *) b, second.tileRows, second.tileCols, second.tileStride));
+        } else {
+            // quarters in Z order: r=a=e=0 s=b=f=1 t=c=g=2 u=d=h=3
+            const size_t qr = result.quadrant(depth + 1);
+            const size_t qf = first.quadrant(depth + 1);
+            const size_t qs = second.quadrant(depth + 1);
+            multSerial(r, a, b, result, first, second, depth + 1);                              // r = ae +
+            multSerial(r, a + qf, b + 2 * qs, result, first, second, depth + 1);                //        + bg
 
-            a = first[iF][jF];
-            b = first[iF][jF+1];
-            c = first[iF+1][jF];
-            d = first[iF+1][jF+1];
+            multSerial(r + qr, a, b + qs, result, first, second, depth + 1);                    // s = af +
+            multSerial(r + qr, a + qf, b + 3 * qs, result, first, second, depth + 1);           //        + bh
 
-            e = second[iS][jS];
-            f = second[iS][jS+1];
-            g = second[iS+1][jS];
-            h = second[iS+1][jS+1];
+            multSerial(r + 2 * qr, a + 2 * qf, b, result, first, second, depth + 1);            // t = ce +
+            multSerial(r + 2 * qr, a + 3 * qf, b + 2 * qs, result, first, second, depth + 1);   //        + dg
 
+            multSerial(r + 3 * qr, a + 2 * qf, b + qs, result, first, second, depth + 1);       // u = cf +
+            multSerial(r + 3 * qr, a + 3 * qf, b + 3 * qs, result, first, second, depth + 1);   //        + dh
+        }
+    }
 
-            result[iR][jR] += a*e + b*g;        // r = ae + bg
-            result[iR][jR+1] += a*f + b*h;      // s = af + bh
-            result[iR+1][jR] += c*e + d*g;      // t = ce + dg
-            result[iR+1][jR+1] += c*f + d*h;    // u = cf + dh
+    template <typename T>
+    void multParallel(T *r, const T *a, const T *b, const MortonMatrix<T> &result,
+            const MortonMatrix<T> &first, const MortonMatrix<T> &second, const int depth) {
+        const int split = result.levels - depth;
+        const int m = result.tileRows << split, k = first.tileCols << split, n = result.tileCols << split;
+        if (split == 0 || m <= grain || k <= grain || n <= grain) {
+            multSerial(r, a, b, result, first, second, depth);
         } else {
-            size >>= 1;    // size = size div 2
-            // r=a=e=[0][0] s=b=f=[0][size]
-            // t=c=g=[size][0] u=d=h=[size][size]
-            multSerial(result, first, second, iR, jR, iF, jF, iS, jS, size);            // r = ae +
-            multSerial(result, first, second, iR, jR, iF, jF+size, iS+size, jS, size);  //        + bg
+            PERF_LEVEL_SCOPE();
+            const size_t qr = result.quadrant(depth + 1);
+            const size_t qf = first.quadrant(depth + 1);
+            const size_t qs = second.quadrant(depth + 1);
+            scheduler::TaskGroup group(scheduler::pool());
+            group.spawn([=, &result, &first, &second]() {
+                multParallel(r, a, b, result, first, second, depth + 1);                            // r = ae +
+                multParallel(r, a + qf, b + 2 * qs, result, first, second, depth + 1);              //        + bg
+            });
+            group.spawn([=, &result, &first, &second]() {
+                multParallel(r + qr, a, b + qs, result, first, second, depth + 1);                  // s = af +
+                multParallel(r + qr, a + qf, b + 3 * qs, result, first, second, depth + 1);         //        + bh
+            });
+            group.spawn([=, &result, &first, &second]() {
+                multParallel(r + 2 * qr, a + 2 * qf, b, result, first, second, depth + 1);          // t = ce +
+                multParallel(r + 2 * qr, a + 3 * qf, b + 2 * qs, result, first, second, depth + 1); //        + dg
+            });
+            group.spawn([=, &result, &first, &second]() {
+                multParallel(r + 3 * qr, a + 2 * qf, b + qs, result, first, second, depth + 1);     // u = cf +
+                multParallel(r + 3 * qr, a + 3 * qf, b + 3 * qs, result, first, second, depth + 1); //        + dh
+            });
+            group.wait();
+        }
+    }
 
-            multSerial(result, first, second, iR, jR+size, iF, jF, iS, jS+size, size);            // s = af +
-            multSerial(result, first, second, iR, jR+size, iF, jF+size, iS+size, jS+size, size);  //        + bh
+    template <typename T>
+    void multiplySerial(MortonMatrix<T> &result, const MortonMatrix<T> &first, const MortonMatrix<T> &second) {
+        result.fill(T());
+        multSerial(result.data, (const T *) first.data, (const T *) second.data, result, first, second, 0);
+    }
 
-            multSerial(result, first, second, iR+size, jR, iF+size, jF, iS, jS, size);            // t = ce +
-            multSerial(result, first, second, iR+size, jR, iF+size, jF+size, iS+size, jS, size);  //        + dg
+    template <typename T>
+    void multiplyParallel(MortonMatrix<T> &result, const MortonMatrix<T> &first, const MortonMatrix<T> &second) {
+        result.fill(T());
+        scheduler::pool().run([&]() {
+            multParallel(result.data, (const T *) first.data, (const T *) second.data, result, first, second, 0);
+        });
+    }
 
-            multSerial(result, first, second, iR+size, jR+size, iF+size, jF, iS, jS+size, size);            // u = cf +
-            multSerial(result, first, second, iR+size, jR+size, iF+size, jF+size, iS+size, jS+size, size);  //        + dh
+    // row-major in and out, the two conversions are part of the call
+    template <typename T>
+    void multiplyMorton(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second,
+            const bool parallel) {
+        const int levels = mortonLevels(first.rows, first.cols, second.cols);
+        MortonMatrix<T> r(result.rows, result.cols, levels);
+        MortonMatrix<T> a(first.rows, first.cols, levels);
+        MortonMatrix<T> b(second.rows, second.cols, levels);
+        a.copyFrom(first);
+        b.copyFrom(second);
+        if (parallel) {
+            multiplyParallel(r, a, b);
+        } else {
+            multiplySerial(r, a, b);
         }
+        r.copyTo(result);
     }
 
-    void multiplySerial(double **result, double **first, double **second, int size) {
-        multSerial(result, first, second, 0, 0, 0, 0, 0, 0, size);
+    template <typename T>
+    void multiplyMortonSerial(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        multiplyMorton(result, first, second, false);
     }
-}
\ No newline at end of file
+
+    template <typename T>
+    void multiplyMortonParallel(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        multiplyMorton(result, first, second, true);
+    }
+}
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <omp.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/* Work-stealing thread pool for fork-join recursion
+*       every worker owns a deque: it pushes and pops its own tasks at the
+*       back (depth first, cache warm), idle workers steal from the front of
+*       other deques (the oldest, i.e. biggest, pieces of work)
+*   Tasks carry their recursion depth. A worker blocked in TaskGroup::wait()
+*   keeps working, but only on tasks deeper than the one it is waiting in, so
+*   nesting on one thread only ever goes down the tree: stack depth and
+*   per-thread arena usage stay bounded by a single root-to-leaf chain.
+*/
+namespace scheduler {
+    struct Task {
+        std::function<void()> run;
+        int depth;
+    };
+
+    class WorkStealingPool;
+
+    // binds the calling thread to one logical cpu, no-op where unsupported
+    void pinCurrentThread(const int cpu) {
+#ifdef __linux__
+        const int cpus = (int) std::thread::hardware_concurrency();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus > 0 ? cpu % cpus : 0, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void) cpu;
+#endif
+    }
+
+    // lets the calling thread run on every online cpu again; the kernel keeps it
+    // inside the process's cpuset, no-op where unsupported
+    void unpinCurrentThread() {
+#ifdef __linux__
+        const int cpus = (int) std::thread::hardware_concurrency();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < (cpus > 0 ? cpus : 1) && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    }
+
+    /* Binds the calling thread to one logical cpu for the lifetime of the
+    *   scope and gives it back its previous cpu set afterwards, so threads
+    *   created later (they inherit the mask) are not confined to that cpu.
+    */
+    class PinnedScope {
+    public:
+        explicit PinnedScope(const int cpu) {
+#ifdef __linux__
+            restore = pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0;
+#endif
+            pinCurrentThread(cpu);
+        }
+
+        ~PinnedScope() {
+#ifdef __linux__
+            if (restore) {
+                pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+            }
+#endif
+        }
+
+        PinnedScope(const PinnedScope &) = delete;
+        PinnedScope &operator=(const PinnedScope &) = delete;
+
+    private:
+#ifdef __linux__
+        cpu_set_t saved;
+        bool restore;
+#endif
+    };
+
+    // identity of the calling thread, set for pool workers only
+    thread_local WorkStealingPool *currentPool = NULL;
+    thread_local int currentWorker = -1;
+    thread_local int currentDepth = -1;
+
+    class WorkStealingPool {
+    public:
+        // pinned: worker i runs on logical cpu i only
+        explicit WorkStealingPool(const int threads, const bool pinned = false)
+                : pinned(pinned), queued(0), stopping(false) {
+            const int count = threads > 0 ? threads : 1;
+            // one deque per worker plus one for tasks submitted from outside
+            for (int i = 0; i <= count; ++i) {
+                queues.push_back(new Queue());
+            }
+            for (int i = 0; i < count; ++i) {
+                workers.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+            }
+        }
+
+        ~WorkStealingPool() {
+            stopping = true;
+            wake.notify_all();
+            for (size_t i = 0; i < workers.size(); ++i) {
+                workers[i].join();
+            }
+            for (size_t i = 0; i < queues.size(); ++i) {
+                delete queues[i];
+            }
+        }
+
+        WorkStealingPool(const WorkStealingPool &) = delete;
+        WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+        int size() const {
+            return (int) workers.size();
+        }
+
+        // workers bound one per cpu (constructor argument)
+        bool pinsWorkers() const {
+            return pinned;
+        }
+
+        // 0 .. size() - 1 on a worker of this pool, -1 anywhere else
+        int workerId() const {
+            return currentPool == this ? currentWorker : -1;
+        }
+
+        void push(const Task &task) {
+            const int id = workerId();
+            Queue &queue = *queues[id >= 0 ? id : size()];
+            {
+                std::lock_guard<std::mutex> guard(queue.lock);
+                queue.tasks.push_back(task);
+            }
+            queued++;
+            wake.notify_one();
+        }
+
+        // run one task deeper than minDepth, false if there was none
+        bool runOne(const int minDepth) {
+            Task task;
+            if (!take(workerId(), minDepth, task)) {
+                return false;
+            }
+            const int depth = currentDepth;
+            currentDepth = task.depth;
+            task.run();
+            currentDepth = depth;
+            return true;
+        }
+
+        // runs job on a worker and blocks until it returns, workers run it inline
+        void run(const std::function<void()> &job) {
+            if (workerId() >= 0) {
+                job();
+                return;
+            }
+            std::mutex doneLock;
+            std::condition_variable doneSignal;
+            bool done = false;
+            Task task;
+            task.depth = 0;
+            task.run = [&]() {
+                job();
+                std::lock_guard<std::mutex> guard(doneLock);
+                done = true;
+                doneSignal.notify_one();
+            };
+            push(task);
+            std::unique_lock<std::mutex> lock(doneLock);
+            doneSignal.wait(lock, [&]() { return done; });
+        }
+
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        const bool pinned;
+        std::vector<std::thread> workers;
+        std::vector<Queue *> queues;
+        std::atomic<int> queued;
+        std::atomic<bool> stopping;
+        std::mutex sleepLock;
+        std::condition_variable wake;
+
+        bool take(const int id, const int minDepth, Task &task) {
+            if (queued.load() == 0) {
+                return false;
+            }
+            if (id >= 0) {
+                Queue &own = *queues[id];
+                std::lock_guard<std::mutex> guard(own.lock);
+                if (!own.tasks.empty() && own.tasks.back().depth > minDepth) {
+                    task = own.tasks.back();
+                    own.tasks.pop_back();
+                    queued--;
+                    return true;
+                }
+            }
+            const int count = (int) queues.size();
+            const int start = id >= 0 ? id + 1 : 0;
+            for (int i = 0; i < count; ++i) {
+                const int victim = (start + i) % count;
+                if (victim == id) {
+                    continue;
+                }
+                Queue &queue = *queues[victim];
+                std::lock_guard<std::mutex> guard(queue.lock);
+                if (!queue.tasks.empty() && queue.tasks.front().depth > minDepth) {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                    queued--;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void workerLoop(const int id) {
+            currentPool = this;
+            currentWorker = id;
+            if (pinned) {
+                pinCurrentThread(id);
+            }
+            while (!stopping) {
+                if (!runOne(-1)) {
+                    std::unique_lock<std::mutex> lock(sleepLock);
+                    wake.wait_for(lock, std::chrono::milliseconds(1),
+                            [this]() { return queued.load() > 0 || stopping.load(); });
+                }
+            }
+        }
+    };
+
+    /* Fork-join scope inside a pool task
+    *       spawn() queues a child one level deeper than the caller, wait()
+    *       returns once every child has finished, helping out meanwhile
+    *   Only use it on a worker thread (inside WorkStealingPool::run).
+    */
+    class TaskGroup {
+    public:
+        explicit TaskGroup(WorkStealingPool &pool) : pool(pool), pending(0), depth(currentDepth + 1) {}
+
+        ~TaskGroup() {
+            wait();
+        }
+
+        void spawn(const std::function<void()> &job) {
+            pending++;
+            Task task;
+            task.depth = depth;
+            task.run = [this, job]() {
+                job();
+                pending--;
+            };
+            pool.push(task);
+        }
+
+        void wait() {
+            while (pending.load() > 0) {
+                if (!pool.runOne(depth - 1)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        WorkStealingPool &pool;
+        std::atomic<int> pending;
+        const int depth;
+    };
+
+    static std::atomic<WorkStealingPool *> sharedPool(NULL);
+    static std::mutex sharedPoolLock;
+
+    // pool shared by all parallel engines, OMP_NUM_THREADS workers by default;
+    // built once even when several threads submit their first work at a time
+    WorkStealingPool &pool() {
+        WorkStealingPool *current = sharedPool.load(std::memory_order_acquire);
+        if (current == NULL) {
+            std::lock_guard<std::mutex> guard(sharedPoolLock);
+            current = sharedPool.load(std::memory_order_relaxed);
+            if (current == NULL) {
+                current = new WorkStealingPool(omp_get_max_threads());
+                sharedPool.store(current, std::memory_order_release);
+            }
+        }
+        return *current;
+    }
+
+    // replaces the shared pool, no multiply may be running at the time
+    void setThreads(const int threads, const bool pinned = false) {
+        std::lock_guard<std::mutex> guard(sharedPoolLock);
+        delete sharedPool.load(std::memory_order_relaxed);
+        sharedPool.store(new WorkStealingPool(threads, pinned), std::memory_order_release);
+    }
+}
+
+#endif
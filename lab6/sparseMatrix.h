@@ -0,0 +1,128 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <vector>
+#include "matrix.h"
+
+/* Compressed sparse row matrix
+*       row i holds values[rowStart[i] .. rowStart[i + 1]), the column of
+*       values[p] is colIndex[p], columns ascending within a row
+*   Built from a dense T** or BasicMatrix<T> by dropping exact zeros.
+*/
+template <typename T>
+class CsrMatrix {
+public:
+    int rows;
+    int cols;
+    std::vector<int> rowStart;      // rows + 1 entries
+    std::vector<int> colIndex;
+    std::vector<T> values;
+
+    CsrMatrix() : rows(0), cols(0), rowStart(1, 0) {}
+
+    // dense is T** or BasicMatrix<T>
+    template <typename M>
+    CsrMatrix(const M &dense, const int rows, const int cols) : rows(rows), cols(cols) {
+        rowStart.reserve(rows + 1);
+        rowStart.push_back(0);
+        for (int i = 0; i < rows; ++i) {
+            const T *row = &dense[i][0];
+            for (int j = 0; j < cols; ++j) {
+                if (row[j] != T()) {
+                    colIndex.push_back(j);
+                    values.push_back(row[j]);
+                }
+            }
+            rowStart.push_back((int) values.size());
+        }
+    }
+
+    explicit CsrMatrix(const BasicMatrix<T> &dense) : CsrMatrix(dense, dense.rows, dense.cols) {}
+
+    size_t nonZeros() const {
+        return values.size();
+    }
+
+    template <typename M>
+    void copyTo(const M &dense) const {
+        for (int i = 0; i < rows; ++i) {
+            T *row = &dense[i][0];
+            for (int j = 0; j < cols; ++j) {
+                row[j] = T();
+            }
+            for (int p = rowStart[i]; p < rowStart[i + 1]; ++p) {
+                row[colIndex[p]] = values[p];
+            }
+        }
+    }
+};
+
+/* Blocked compressed sparse row matrix
+*       the matrix is cut into block x block tiles and only tiles holding a
+*       non-zero are kept, each one dense and row-major in values; block row
+*       b holds tiles blockRowStart[b] .. blockRowStart[b + 1], tile p sits
+*       in block column blockCol[p]
+*   Edge tiles are padded with zeros. Suits matrices whose non-zeros come
+*   in small dense clusters (finite elements, several unknowns per node):
+*   one column index per tile instead of per value, and the inner loops
+*   have a fixed length.
+*/
+template <typename T>
+class BlockCsrMatrix {
+public:
+    int rows;
+    int cols;
+    int block;
+    std::vector<int> blockRowStart;
+    std::vector<int> blockCol;
+    std::vector<T> values;          // block * block per tile
+
+    BlockCsrMatrix() : rows(0), cols(0), block(1), blockRowStart(1, 0) {}
+
+    template <typename M>
+    BlockCsrMatrix(const M &dense, const int rows, const int cols, const int block)
+            : rows(rows), cols(cols), block(block) {
+        const int blockRows = (rows + block - 1) / block, blockCols = (cols + block - 1) / block;
+        blockRowStart.reserve(blockRows + 1);
+        blockRowStart.push_back(0);
+        for (int bi = 0; bi < blockRows; ++bi) {
+            const int height = rows - bi * block < block ? rows - bi * block : block;
+            for (int bj = 0; bj < blockCols; ++bj) {
+                const int width = cols - bj * block < block ? cols - bj * block : block;
+                bool nonZero = false;
+                for (int i = 0; i < height && !nonZero; ++i) {
+                    const T *row = &dense[bi * block + i][bj * block];
+                    for (int j = 0; j < width; ++j) {
+                        if (row[j] != T()) {
+                            nonZero = true;
+                            break;
+                        }
+                    }
+                }
+                if (!nonZero) {
+                    continue;
+                }
+                blockCol.push_back(bj);
+                for (int i = 0; i < block; ++i) {
+                    for (int j = 0; j < block; ++j) {
+                        values.push_back(i < height && j < width ? dense[bi * block + i][bj * block + j] : T());
+                    }
+                }
+            }
+            blockRowStart.push_back((int) blockCol.size());
+        }
+    }
+
+    BlockCsrMatrix(const BasicMatrix<T> &dense, const int block)
+            : BlockCsrMatrix(dense, dense.rows, dense.cols, block) {}
+
+    size_t tiles() const {
+        return blockCol.size();
+    }
+
+    const T *tile(const int p) const {
+        return &values[(size_t) p * block * block];
+    }
+};
+
+#endif
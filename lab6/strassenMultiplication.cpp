@@ -0,0 +1,165 @@
+#include "matrix.h"
+#include "gemmKernel.h"
+#include "perfCounters.h"
+
+/* Cormen, Leiserson, Rivest, Stein. Introduction to Algorithms, 2nd Ed.
+* Chapter 28.  Matrix Operations
+*       28.2 Strassen's algorithm for matrix multiplication
+* Boyer, Dumas, Pernet, Zhou. Memory efficient scheduling of Strassen-Winograd's
+* matrix multiplication algorithm.
+*       result = first * second
+*   Winograd's form of Strassen: 7 products and 15 additions per level instead
+*   of 8 products, O(n^2.807). Below cutoff the blocked classical kernel takes
+*   over.
+*   Any shape works: odd dimensions are peeled (Huss-Lederman et al.), the
+*   even-sized leading block goes through Strassen and the leftover row,
+*   column and rank-1 term are added with the classical kernel.
+*   Temporaries: per level one X (holds S1..S4 and P1) and one Y (T1..T4),
+*   the other products are built directly inside the result quadrants.
+*   All levels share a single workspace allocated up front.
+*/
+namespace strassen {
+    // below this size the blocked kernel is faster than one more level
+    int cutoff = 128;
+
+    /****************************************************************************/
+    /*   S1 = A21 + A22     T1 = B12 - B11     P1 = A11 B11    U1 = P1 + P2     */
+    /*   S2 = S1 - A11      T2 = B22 - T1      P2 = A12 B21    U2 = P1 + P6     */
+    /*   S3 = A11 - A21     T3 = B22 - B12     P3 = S4 B22     U3 = U2 + P7     */
+    /*   S4 = A12 - S2      T4 = T2 - B21      P4 = A22 T4     U4 = U2 + P5     */
+    /*                                         P5 = S1 T1      U5 = U4 + P3     */
+    /*   C11 = U1   C12 = U5                   P6 = S2 T2      U6 = U3 - P4     */
+    /*   C21 = U6   C22 = U7                   P7 = S3 T3      U7 = U3 + P5     */
+    /****************************************************************************/
+
+    static bool isBaseCase(const int m, const int k, const int n) {
+        return m <= cutoff || k <= cutoff || n <= cutoff;
+    }
+
+    // elements needed by X and Y of one level
+    template <typename T>
+    static size_t levelSize(const int m, const int k, const int n) {
+        const int strideK = BasicMatrix<T>::paddedStride(k / 2), strideN = BasicMatrix<T>::paddedStride(n / 2);
+        const size_t x = (size_t) (m / 2) * (strideK > strideN ? strideK : strideN);
+        const size_t y = (size_t) (k / 2) * strideN;
+        return x + y;
+    }
+
+    // elements of workspace needed for (m x k) * (k x n), all levels together,
+    // peeling does not change x / 2, so odd sizes need no special case
+    template <typename T>
+    size_t workspaceSize(const int m, const int k, const int n) {
+        if (isBaseCase(m, k, n)) {
+            return 0;
+        }
+        return levelSize<T>(m, k, n) + workspaceSize<T>(m / 2, k / 2, n / 2);
+    }
+
+    template <typename T>
+    static void add(const BasicMatrix<T> &C, const BasicMatrix<T> &A, const BasicMatrix<T> &B) {
+        for (int i = 0; i < C.rows; ++i) {
+            T *c = C[i];
+            const T *a = A[i], *b = B[i];
+            for (int j = 0; j < C.cols; ++j) {
+                c[j] = a[j] + b[j];
+            }
+        }
+    }
+
+    template <typename T>
+    static void sub(const BasicMatrix<T> &C, const BasicMatrix<T> &A, const BasicMatrix<T> &B) {
+        for (int i = 0; i < C.rows; ++i) {
+            T *c = C[i];
+            const T *a = A[i], *b = B[i];
+            for (int j = 0; j < C.cols; ++j) {
+                c[j] = a[j] - b[j];
+            }
+        }
+    }
+
+    template <typename T>
+    void multSerial(const BasicMatrix<T> &C, const BasicMatrix<T> &A, const BasicMatrix<T> &B, T *workspace) {
+        PERF_LEVEL_SCOPE();
+        const int m = C.rows, k = A.cols, n = C.cols;
+        if (isBaseCase(m, k, n)) {
+            kernel::multiply(C, A, B);
+            return;
+        }
+        const int m2 = m / 2, k2 = k / 2, n2 = n / 2;
+        const int mEven = 2 * m2, kEven = 2 * k2, nEven = 2 * n2;
+
+        BasicMatrix<T> A11 = A.view(0, 0, m2, k2), A12 = A.view(0, k2, m2, k2);
+        BasicMatrix<T> A21 = A.view(m2, 0, m2, k2), A22 = A.view(m2, k2, m2, k2);
+        BasicMatrix<T> B11 = B.view(0, 0, k2, n2), B12 = B.view(0, n2, k2, n2);
+        BasicMatrix<T> B21 = B.view(k2, 0, k2, n2), B22 = B.view(k2, n2, k2, n2);
+        BasicMatrix<T> C11 = C.view(0, 0, m2, n2), C12 = C.view(0, n2, m2, n2);
+        BasicMatrix<T> C21 = C.view(m2, 0, m2, n2), C22 = C.view(m2, n2, m2, n2);
+
+        const int strideK = BasicMatrix<T>::paddedStride(k2), strideN = BasicMatrix<T>::paddedStride(n2);
+        BasicMatrix<T> S(workspace, m2, k2, strideK);       // X as S1..S4
+        BasicMatrix<T> P1(workspace, m2, n2, strideN);      // X as P1
+        BasicMatrix<T> Y(workspace + (size_t) m2 * (strideK > strideN ? strideK : strideN), k2, n2, strideN);
+        T *deeper = workspace + levelSize<T>(m, k, n);
+
+        sub(S, A11, A21);                   // S3
+        sub(Y, B22, B12);                   // T3
+        multSerial(C21, S, Y, deeper);      // P7
+        add(S, A21, A22);                   // S1
+        sub(Y, B12, B11);                   // T1
+        multSerial(C22, S, Y, deeper);      // P5
+        sub(S, S, A11);                     // S2 = S1 - A11
+        sub(Y, B22, Y);                     // T2 = B22 - T1
+        multSerial(C12, S, Y, deeper);      // P6
+        sub(S, A12, S);                     // S4 = A12 - S2
+        multSerial(C11, S, B22, deeper);    // P3
+        multSerial(P1, A11, B11, deeper);   // P1, S is dead from here on
+        add(C12, P1, C12);                  // U2 = P1 + P6
+        add(C21, C12, C21);                 // U3 = U2 + P7
+        add(C12, C12, C22);                 // U4 = U2 + P5
+        add(C22, C21, C22);                 // U7 = U3 + P5
+        add(C12, C12, C11);                 // U5 = U4 + P3
+        sub(Y, Y, B21);                     // T4 = T2 - B21
+        multSerial(C11, A22, Y, deeper);    // P4
+        sub(C21, C21, C11);                 // U6 = U3 - P4
+        multSerial(C11, A12, B21, deeper);  // P2
+        add(C11, P1, C11);                  // U1 = P1 + P2
+
+        // peel the odd edges:  | C  c |   | A  a |   | B  b |
+        //                      | r  x | = | w  y | * | v  z |
+        if (k != kEven) {   // C += a v
+            kernel::multiplyAdd(C, 0, 0, A, 0, kEven, B, kEven, 0, mEven, nEven, 1);
+        }
+        if (n != nEven) {   // [c; x] = [A a; w y] * [b; z]
+            kernel::clear(C, 0, nEven, m, 1);
+            kernel::multiplyAdd(C, 0, nEven, A, 0, 0, B, 0, nEven, m, 1, k);
+        }
+        if (m != mEven) {   // r = [w y] * [B; v]
+            kernel::clear(C, mEven, 0, 1, nEven);
+            kernel::multiplyAdd(C, mEven, 0, A, mEven, 0, B, 0, 0, 1, nEven, k);
+        }
+    }
+
+    // workspace has to hold workspaceSize<T>(first.rows, first.cols, second.cols) elements
+    template <typename T>
+    void multiplySerial(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second,
+            T *workspace) {
+        multSerial(result, first, second, workspace);
+    }
+
+    template <typename T>
+    void multiplySerial(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        T *workspace = (T *) alignedMalloc(
+                workspaceSize<T>(first.rows, first.cols, second.cols) * sizeof(T));
+        multSerial(result, first, second, workspace);
+        alignedFree(workspace);
+    }
+
+    template <typename T>
+    void multiplySerial(T **result, T **first, T **second, const int size) {
+        BasicMatrix<T> a(size, size), b(size, size), c(size, size);
+        a.copyFrom(first);
+        b.copyFrom(second);
+        multiplySerial(c, a, b);
+        c.copyTo(result);
+    }
+}
@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+#include "matrix.h"
+#include "sparseMatrix.h"
+#include "gemmKernel.h"
+
+/* Sparse and structured operands
+*       CSR / blocked CSR times dense and dense times CSR (SpMM)
+*       banded and triangular operands: the blocked kernel on the part of
+*           every row panel (left) or column panel (right) inside the band
+*       first * first^T: only blocks on and above the diagonal, mirrored
+*   analyze() scans an operand once for its density, block density and
+*   bandwidths and prices every path as a fraction of the dense work;
+*   multiply() takes the cheapest one, dense inputs go to autotune::multiply.
+*   A lower triangular matrix is a band with upper == 0, an upper one has
+*   lower == 0, a symmetric first times itself is first * first^T.
+*   Zeros are exact zeros (T() ==), nothing is dropped by magnitude.
+*   Include after autotune.cpp.
+*/
+namespace structured {
+    enum Kind {
+        DENSE,
+        SPARSE,
+        BLOCK_SPARSE,
+        BANDED,
+        LOWER,
+        UPPER,
+        KINDS
+    };
+
+    const char *kindNames[KINDS] = {"dense", "sparse", "blockSparse", "banded", "lower", "upper"};
+
+    // rows (left operand) or columns (right operand) of one band panel
+    int panel = 128;
+    // tile edge of the blocked CSR form
+    int block = 4;
+    // time per multiply-add relative to the blocked kernel, SpMM streams
+    // rows of the dense operand instead of packing it
+    double sparseCost = 3;
+    double blockSparseCost = 1.5;
+    // columns of C a CSR row updates at a time, stays in L1 across the row
+    const int COLUMNS_BLOCK = 512;
+
+    struct Structure {
+        Kind kind;              // cheapest path for this operand
+        double cost;            // its work relative to the dense product, 1 for DENSE
+        double density;         // non-zeros / elements
+        double blockDensity;    // block x block tiles holding a non-zero / tiles
+        int lower;              // max i - j over the non-zeros
+        int upper;              // max j - i over the non-zeros
+    };
+
+    // fraction of the dense work left when every panel skips what is outside the band
+    static double bandWork(const int rows, const int cols, const int lower, const int upper, const bool left) {
+        // a left operand is cut into row panels, a right one into column panels
+        const int along = left ? rows : cols, across = left ? cols : rows;
+        const int before = left ? lower : upper, after = left ? upper : lower;
+        double work = 0;
+        for (int start = 0; start < along; start += panel) {
+            const int size = std::min(panel, along - start);
+            const int lo = std::max(0, start - before), hi = std::min(across, start + size + after);
+            work += (double) size * std::max(0, hi - lo);
+        }
+        return along > 0 && across > 0 ? work / ((double) along * across) : 0;
+    }
+
+    // one pass over a rows x cols operand (T** or BasicMatrix<T>); left: it is first
+    template <typename M>
+    Structure analyze(const M &matrix, const int rows, const int cols, const bool left) {
+        typedef typename ElementOf<M>::type T;
+        const int blockCols = (cols + block - 1) / block;
+        std::vector<char> seen(blockCols > 0 ? blockCols : 1, 0);
+        size_t nonZeros = 0, tiles = 0;
+        int lower = -std::max(rows, cols), upper = lower;
+        for (int i = 0; i < rows; ++i) {
+            if (i % block == 0) {
+                std::fill(seen.begin(), seen.end(), 0);
+            }
+            const T *row = &matrix[i][0];
+            int first = -1, last = -1;
+            for (int j = 0; j < cols; ++j) {
+                if (row[j] != T()) {
+                    if (first < 0) {
+                        first = j;
+                    }
+                    last = j;
+                    ++nonZeros;
+                    if (!seen[j / block]) {
+                        seen[j / block] = 1;
+                        ++tiles;
+                    }
+                }
+            }
+            if (first >= 0) {
+                lower = std::max(lower, i - first);
+                upper = std::max(upper, last - i);
+            }
+        }
+
+        Structure structure;
+        const double elements = (double) rows * cols;
+        const double allTiles = (double) ((rows + block - 1) / block) * blockCols;
+        structure.density = elements > 0 ? nonZeros / elements : 0;
+        structure.blockDensity = allTiles > 0 ? tiles / allTiles : 0;
+        structure.lower = lower;
+        structure.upper = upper;
+
+        structure.kind = DENSE;
+        structure.cost = 1;
+        const double band = bandWork(rows, cols, lower, upper, left);
+        if (band < structure.cost) {
+            structure.kind = upper <= 0 && lower > 0 ? LOWER : lower <= 0 && upper > 0 ? UPPER : BANDED;
+            structure.cost = band;
+        }
+        if (structure.density * sparseCost < structure.cost) {
+            structure.kind = SPARSE;
+            structure.cost = structure.density * sparseCost;
+        }
+        // dense times blocked CSR is not implemented, CSR covers the right side
+        if (left && structure.blockDensity * blockSparseCost < structure.cost) {
+            structure.kind = BLOCK_SPARSE;
+            structure.cost = structure.blockDensity * blockSparseCost;
+        }
+        return structure;
+    }
+
+    // second == first^T, first is m x k; stops at the first mismatch
+    template <typename TA, typename TB>
+    bool isTranspose(const TA &first, const TB &second, const int m, const int k) {
+        for (int i = 0; i < m; ++i) {
+            for (int j = 0; j < k; ++j) {
+                if (first[i][j] != second[j][i]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /* SpMM
+    *       C (m x n) = A (m x k, CSR) * B (k x n)
+    *   Row i of C is the sum of A[i][p] * row p of B over the non-zeros of
+    *   row i: whole rows of B, unit stride, no indexing in the inner loop.
+    */
+    template <typename T, typename TC, typename TB>
+    void multiply(const TC &C, const CsrMatrix<T> &A, const TB &B, const int n) {
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int i = 0; i < A.rows; ++i) {
+            T *c = &C[i][0];
+            for (int j0 = 0; j0 < n; j0 += COLUMNS_BLOCK) {
+                const int j1 = std::min(n, j0 + COLUMNS_BLOCK);
+                for (int j = j0; j < j1; ++j) {
+                    c[j] = T();
+                }
+                for (int p = A.rowStart[i]; p < A.rowStart[i + 1]; ++p) {
+                    const T a = A.values[p];
+                    const T *b = &B[A.colIndex[p]][0];
+                    #pragma omp simd
+                    for (int j = j0; j < j1; ++j) {
+                        c[j] += a * b[j];
+                    }
+                }
+            }
+        }
+    }
+
+    // C (m x n) = A (m x k) * B (k x n, CSR): row p of B is scattered into row i of C
+    template <typename T, typename TC, typename TA>
+    void multiply(const TC &C, const TA &A, const CsrMatrix<T> &B, const int m) {
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int i = 0; i < m; ++i) {
+            T *c = &C[i][0];
+            const T *a = &A[i][0];
+            for (int j = 0; j < B.cols; ++j) {
+                c[j] = T();
+            }
+            for (int p = 0; p < B.rows; ++p) {
+                if (a[p] == T()) {
+                    continue;
+                }
+                for (int q = B.rowStart[p]; q < B.rowStart[p + 1]; ++q) {
+                    c[B.colIndex[q]] += a[p] * B.values[q];
+                }
+            }
+        }
+    }
+
+    // C (m x n) = A (m x k, blocked CSR) * B (k x n), one block row of C per task
+    template <typename T, typename TC, typename TB>
+    void multiply(const TC &C, const BlockCsrMatrix<T> &A, const TB &B, const int n) {
+        const int size = A.block, blockRows = (int) A.blockRowStart.size() - 1;
+        #pragma omp parallel for schedule(dynamic, 4)
+        for (int bi = 0; bi < blockRows; ++bi) {
+            const int height = std::min(size, A.rows - bi * size);
+            kernel::clear(C, bi * size, 0, height, n);
+            for (int p = A.blockRowStart[bi]; p < A.blockRowStart[bi + 1]; ++p) {
+                const T *tile = A.tile(p);
+                const int col = A.blockCol[p] * size, width = std::min(size, A.cols - col);
+                for (int r = 0; r < height; ++r) {
+                    T *c = &C[bi * size + r][0];
+                    for (int q = 0; q < width; ++q) {
+                        const T a = tile[r * size + q];
+                        if (a == T()) {
+                            continue;
+                        }
+                        const T *b = &B[col + q][0];
+                        #pragma omp simd
+                        for (int j = 0; j < n; ++j) {
+                            c[j] += a * b[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /* Banded operands
+    *       A[i][j] == 0 unless -lower <= j - i <= upper (left), likewise B
+    *   Row panel [i0, i1) of a banded A only reaches columns
+    *   [i0 - lower, i1 + upper), so C's panel is the kernel on that slice of
+    *   A and the matching rows of B; a banded B works on column panels of C.
+    *   Triangular operands are the one-sided case.
+    */
+    template <typename TC, typename TA, typename TB>
+    void multiplyBandedLeft(const TC &C, const TA &A, const TB &B,
+            const int m, const int k, const int n, const int lower, const int upper) {
+        const int panels = (m + panel - 1) / panel;
+        #pragma omp parallel for schedule(dynamic)
+        for (int p = 0; p < panels; ++p) {
+            const int i0 = p * panel, rows = std::min(panel, m - i0);
+            const int lo = std::max(0, i0 - lower), hi = std::min(k, i0 + rows + upper);
+            kernel::clear(C, i0, 0, rows, n);
+            if (hi > lo) {
+                kernel::multiplyAdd(C, i0, 0, A, i0, lo, B, lo, 0, rows, n, hi - lo);
+            }
+        }
+    }
+
+    template <typename TC, typename TA, typename TB>
+    void multiplyBandedRight(const TC &C, const TA &A, const TB &B,
+            const int m, const int k, const int n, const int lower, const int upper) {
+        const int panels = (n + panel - 1) / panel;
+        #pragma omp parallel for schedule(dynamic)
+        for (int p = 0; p < panels; ++p) {
+            const int j0 = p * panel, cols = std::min(panel, n - j0);
+            const int lo = std::max(0, j0 - upper), hi = std::min(k, j0 + cols + lower);
+            kernel::clear(C, 0, j0, m, cols);
+            if (hi > lo) {
+                kernel::multiplyAdd(C, 0, j0, A, 0, lo, B, lo, j0, m, cols, hi - lo);
+            }
+        }
+    }
+
+    // C (m x m) = A (m x k) * A^T given as B: C is symmetric, half is computed and mirrored
+    template <typename TC, typename TA, typename TB>
+    void multiplySymmetric(const TC &C, const TA &A, const TB &B, const int m, const int k) {
+        typedef typename ElementOf<TC>::type T;
+        const int panels = (m + panel - 1) / panel;
+        std::vector<std::pair<int, int> > blocks;
+        for (int bi = 0; bi < panels; ++bi) {
+            for (int bj = bi; bj < panels; ++bj) {
+                blocks.push_back(std::make_pair(bi, bj));
+            }
+        }
+        #pragma omp parallel for schedule(dynamic)
+        for (int b = 0; b < (int) blocks.size(); ++b) {
+            const int i0 = blocks[b].first * panel, j0 = blocks[b].second * panel;
+            const int rows = std::min(panel, m - i0), cols = std::min(panel, m - j0);
+            kernel::clear(C, i0, j0, rows, cols);
+            kernel::multiplyAdd(C, i0, j0, A, i0, 0, B, 0, j0, rows, cols, k);
+        }
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int i = panel; i < m; ++i) {
+            T *c = &C[i][0];
+            // left of the diagonal block of row i, the diagonal blocks are complete
+            const int end = i / panel * panel;
+            for (int j = 0; j < end; ++j) {
+                c[j] = C[j][i];
+            }
+        }
+    }
+
+    /* result = first * second on the cheapest path for both operands' structure
+    *   false: both are dense, nothing was written
+    */
+    template <typename TC, typename TA, typename TB>
+    bool multiplyStructured(const TC &C, const TA &A, const TB &B, const int m, const int k, const int n) {
+        typedef typename ElementOf<TC>::type T;
+        const Structure left = analyze(A, m, k, true), right = analyze(B, k, n, false);
+        const bool useLeft = left.cost <= right.cost;
+        const Structure &chosen = useLeft ? left : right;
+        // C = A A^T is half of the dense work
+        if (chosen.cost >= 0.5 && m == n && isTranspose(A, B, m, k)) {
+            multiplySymmetric(C, A, B, m, k);
+            return true;
+        }
+        switch (chosen.kind) {
+            case DENSE:
+                return false;
+            case SPARSE:
+                if (useLeft) {
+                    multiply(C, CsrMatrix<T>(A, m, k), B, n);
+                } else {
+                    multiply(C, A, CsrMatrix<T>(B, k, n), m);
+                }
+                return true;
+            case BLOCK_SPARSE:
+                multiply(C, BlockCsrMatrix<T>(A, m, k, block), B, n);
+                return true;
+            default:
+                if (useLeft) {
+                    multiplyBandedLeft(C, A, B, m, k, n, chosen.lower, chosen.upper);
+                } else {
+                    multiplyBandedRight(C, A, B, m, k, n, chosen.lower, chosen.upper);
+                }
+                return true;
+        }
+    }
+
+    template <typename T>
+    void multiply(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        if (!multiplyStructured(result, first, second, first.rows, first.cols, second.cols)) {
+            autotune::multiply(result, first, second);
+        }
+    }
+
+    template <typename T>
+    void multiply(T **result, T **first, T **second, const int size) {
+        if (!multiplyStructured(result, first, second, size, size, size)) {
+            autotune::multiply(result, first, second, size);
+        }
+    }
+}
@@ -1,28 +1,40 @@
+#ifndef UTILS_H
+#define UTILS_H
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include "matrix.h"
 
-double **createMatrix(const int sizeA, const int sizeB){
-    double **matrix = (double **) malloc(sizeA * sizeof(double *));
+// row table and rows in one block, so freeMatrix releases everything
+template <typename T = double>
+T **createMatrix(const int sizeA, const int sizeB){
+    T **matrix = (T **) malloc(sizeA * sizeof(T *) + (size_t) sizeA * sizeB * sizeof(T));
+    T *rows = (T *) (matrix + sizeA);
     for (int i = 0; i < sizeA; ++i) {
-        matrix[i] = (double *) malloc(sizeB * sizeof(double));
+        matrix[i] = rows + (size_t) i * sizeB;
     }
     return matrix;
 }
 
-void printMatrix(double **matrix, const int sizeA, const int sizeB) {
+template <typename T>
+void printMatrix(T **matrix, const int sizeA, const int sizeB) {
     for (int i = 0; i < sizeA; i++) {
         for (int j = 0; j < sizeB; j++) {
-            printf("%8.2f", matrix[i][j]);
+            printValue(matrix[i][j]);
         }
         printf("\n");
     }
 }
 
-void freeMatrix(double **matrix) {
+template <typename T>
+void freeMatrix(T **matrix) {
     free(matrix);
 }
 
-bool isCorrect(double **src, double **matrix, const int sizeA, const int sizeB){
+template <typename T>
+bool isCorrect(T **src, T **matrix, const int sizeA, const int sizeB){
     for (int i = 0; i < sizeA; ++i) {
         for (int j = 0; j < sizeB; ++j) {
             if(src[i][j] != matrix[i][j]){
@@ -31,4 +43,19 @@ bool isCorrect(double **src, double **matrix, const int sizeA, const int sizeB){
         }
     }
     return true;
-}
\ No newline at end of file
+}
+
+// floating point results: equal up to tolerance relative to the largest |src|
+template <typename T>
+bool isCorrect(T **src, T **matrix, const int sizeA, const int sizeB, const double tolerance){
+    double diff = 0, scale = 0;
+    for (int i = 0; i < sizeA; ++i) {
+        for (int j = 0; j < sizeB; ++j) {
+            diff = std::max(diff, (double) std::abs(src[i][j] - matrix[i][j]));
+            scale = std::max(scale, (double) std::abs(src[i][j]));
+        }
+    }
+    return diff <= tolerance * (scale > 0 ? scale : 1);
+}
+
+#endif
@@ -1,23 +1,24 @@
 #include <iostream>
-#include <conio.h>
 #include <stdlib.h>
+#include "matrix.h"
 
 namespace winograd {
-    void multiplySerial(double **result, double **first, double **second, const int size) {
+    template <typename T>
+    void multiplySerial(T **result, T **first, T **second, const int size) {
         const int d = size / 2;
-        double *rowFactor = (double *) malloc(size * sizeof(double));
+        T *rowFactor = (T *) malloc(size * sizeof(T));
         for (int i = 0; i < size; ++i) {
-            rowFactor[i] = first[i][0] * first[i][1];
-            for (int j = 1; j < d; ++j) {
-                rowFactor[i] += first[i][2 * j - 1] * first[i][2 * j];
+            rowFactor[i] = T();
+            for (int j = 0; j < d; ++j) {
+                rowFactor[i] += first[i][2 * j] * first[i][2 * j + 1];
             }
         }
 
-        double *columnFactor = (double *) malloc(size * sizeof(double));
+        T *columnFactor = (T *) malloc(size * sizeof(T));
         for (int i = 0; i < size; ++i) {
-            columnFactor[i] = second[0][i] * second[1][i];
-            for (int j = 1; j < d; ++j) {
-                columnFactor[i] += second[2 * j - 1][i] * second[2 * j][i];
+            columnFactor[i] = T();
+            for (int j = 0; j < d; ++j) {
+                columnFactor[i] += second[2 * j][i] * second[2 * j + 1][i];
             }
         }
 
@@ -27,27 +28,35 @@ namespace winograd {
                 for (int k = 0; k < d; ++k) {
                     result[i][j] += (first[i][2 * k] + second[2 * k + 1][j]) * (first[i][2 * k + 1] + second[2 * k][j]);
                 }
+                if (size & 1) {
+                    // odd size: the last column of first has no partner
+                    result[i][j] += first[i][size - 1] * second[size - 1][j];
+                }
             }
         }
+
+        free(rowFactor);
+        free(columnFactor);
     }
 
-    void multiplyParallel(double **result, double **first, double **second, const int size) {
+    template <typename T>
+    void multiplyParallel(T **result, T **first, T **second, const int size) {
         const int d = size / 2;
-        double *rowFactor = (double *) malloc(size * sizeof(double));
+        T *rowFactor = (T *) malloc(size * sizeof(T));
         #pragma omp parallel for
         for (int i = 0; i < size; ++i) {
-            rowFactor[i] = first[i][0] * first[i][1];
-            for (int j = 1; j < d; ++j) {
-                rowFactor[i] += first[i][2 * j - 1] * first[i][2 * j];
+            rowFactor[i] = T();
+            for (int j = 0; j < d; ++j) {
+                rowFactor[i] += first[i][2 * j] * first[i][2 * j + 1];
             }
         }
 
-        double *columnFactor = (double *) malloc(size * sizeof(double));
+        T *columnFactor = (T *) malloc(size * sizeof(T));
         #pragma omp parallel for
         for (int i = 0; i < size; ++i) {
-            columnFactor[i] = second[0][i] * second[1][i];
-            for (int j = 1; j < d; ++j) {
-                columnFactor[i] += second[2 * j - 1][i] * second[2 * j][i];
+            columnFactor[i] = T();
+            for (int j = 0; j < d; ++j) {
+                columnFactor[i] += second[2 * j][i] * second[2 * j + 1][i];
             }
         }
 
@@ -58,7 +67,100 @@ namespace winograd {
                 for (int k = 0; k < d; ++k) {
                     result[i][j] += (first[i][2 * k] + second[2 * k + 1][j]) * (first[i][2 * k + 1] + second[2 * k][j]);
                 }
+                if (size & 1) {
+                    // odd size: the last column of first has no partner
+                    result[i][j] += first[i][size - 1] * second[size - 1][j];
+                }
+            }
+        }
+
+        free(rowFactor);
+        free(columnFactor);
+    }
+
+    /* Same algorithm on the contiguous BasicMatrix layout
+    *       result (m x n) = first (m x k) * second (k x n), any shape
+    *       rows of first / second / result are read through one base pointer
+    *       and a stride instead of a table of row pointers
+    */
+    template <typename T>
+    void multiplySerial(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        const int m = result.rows, n = result.cols, inner = first.cols;
+        const int d = inner / 2;
+        T *rowFactor = (T *) malloc(m * sizeof(T));
+        for (int i = 0; i < m; ++i) {
+            const T *row = first[i];
+            rowFactor[i] = T();
+            for (int j = 0; j < d; ++j) {
+                rowFactor[i] += row[2 * j] * row[2 * j + 1];
+            }
+        }
+
+        T *columnFactor = (T *) malloc(n * sizeof(T));
+        for (int i = 0; i < n; ++i) {
+            columnFactor[i] = T();
+            for (int j = 0; j < d; ++j) {
+                columnFactor[i] += second[2 * j][i] * second[2 * j + 1][i];
+            }
+        }
+
+        for (int i = 0; i < m; ++i) {
+            const T *row = first[i];
+            T *out = result[i];
+            for (int j = 0; j < n; ++j) {
+                out[j] = -rowFactor[i] - columnFactor[j];
+                for (int k = 0; k < d; ++k) {
+                    out[j] += (row[2 * k] + second[2 * k + 1][j]) * (row[2 * k + 1] + second[2 * k][j]);
+                }
+                if (inner & 1) {
+                    out[j] += row[inner - 1] * second[inner - 1][j];
+                }
             }
         }
+
+        free(rowFactor);
+        free(columnFactor);
+    }
+
+    template <typename T>
+    void multiplyParallel(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        const int m = result.rows, n = result.cols, inner = first.cols;
+        const int d = inner / 2;
+        T *rowFactor = (T *) malloc(m * sizeof(T));
+        #pragma omp parallel for
+        for (int i = 0; i < m; ++i) {
+            const T *row = first[i];
+            rowFactor[i] = T();
+            for (int j = 0; j < d; ++j) {
+                rowFactor[i] += row[2 * j] * row[2 * j + 1];
+            }
+        }
+
+        T *columnFactor = (T *) malloc(n * sizeof(T));
+        #pragma omp parallel for
+        for (int i = 0; i < n; ++i) {
+            columnFactor[i] = T();
+            for (int j = 0; j < d; ++j) {
+                columnFactor[i] += second[2 * j][i] * second[2 * j + 1][i];
+            }
+        }
+
+        #pragma omp parallel for
+        for (int i = 0; i < m; ++i) {
+            const T *row = first[i];
+            T *out = result[i];
+            for (int j = 0; j < n; ++j) {
+                out[j] = -rowFactor[i] - columnFactor[j];
+                for (int k = 0; k < d; ++k) {
+                    out[j] += (row[2 * k] + second[2 * k + 1][j]) * (row[2 * k + 1] + second[2 * k][j]);
+                }
+                if (inner & 1) {
+                    out[j] += row[inner - 1] * second[inner - 1][j];
+                }
+            }
+        }
+
+        free(rowFactor);
+        free(columnFactor);
     }
 }
\ No newline at end of file
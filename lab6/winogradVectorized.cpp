@@ -0,0 +1,524 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include "matrix.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define WINOGRAD_X86 1
+#endif
+
+/* Vectorized Winograd
+*       result[i][j] = -rowFactor[i] - columnFactor[j]
+*                      + sum_k (first[i][2k] + second[2k+1][j]) * (first[i][2k+1] + second[2k][j])
+*   The loops run as (i, k, j) instead of (i, j, k): for fixed i and k the
+*   first[i][..] terms are scalars and second[2k][..] / second[2k+1][..] are
+*   rows, so j is the unit stride direction and maps onto SIMD lanes.
+*   second is packed strip by strip (PAIRS_BLOCK pairs of rows x COLUMNS_BLOCK
+*   columns, even row followed by odd row), every strip is reused by all rows
+*   of first while it sits in L2, four result rows are updated per pass over
+*   the strip.
+*   The strip kernel is picked once at runtime: AVX-512F, AVX2 + FMA, SSE2 or
+*   plain C, so one binary runs at full width on every x86 host. That choice
+*   is for double; other element types run the plain C strip, which the
+*   compiler vectorizes for the build target.
+*   The prepared operand below is double only.
+*/
+namespace winograd {
+    const int COLUMNS_BLOCK = 256;
+    const int PAIRS_BLOCK = 128;
+    const int ROWS_BLOCK = 4;
+
+    // out[r][j] += sum_k (a[r][2k] + odd_k[j]) * (a[r][2k+1] + even_k[j]) for r < ROWS_BLOCK, j < width
+    typedef void (*StripKernel)(double *const *out, const double *const *a,
+            const double *packed, const int pairs, const int width);
+
+    // plain C strip, the only one for element types other than double
+    template <typename T>
+    static void stripGeneric(T *const *out, const T *const *a,
+            const T *packed, const int pairs, const int width) {
+        for (int k = 0; k < pairs; ++k) {
+            const T *even = packed + (size_t) k * 2 * COLUMNS_BLOCK;
+            const T *odd = even + COLUMNS_BLOCK;
+            for (int r = 0; r < ROWS_BLOCK; ++r) {
+                const T x = a[r][2 * k], y = a[r][2 * k + 1];
+                T *row = out[r];
+                for (int j = 0; j < width; ++j) {
+                    row[j] += (x + odd[j]) * (y + even[j]);
+                }
+            }
+        }
+    }
+
+#ifdef WINOGRAD_X86
+    __attribute__((target("sse2")))
+    static void stripSse2(double *const *out, const double *const *a,
+            const double *packed, const int pairs, const int width) {
+        for (int k = 0; k < pairs; ++k) {
+            const double *even = packed + (size_t) k * 2 * COLUMNS_BLOCK;
+            const double *odd = even + COLUMNS_BLOCK;
+            __m128d x[ROWS_BLOCK], y[ROWS_BLOCK];
+            for (int r = 0; r < ROWS_BLOCK; ++r) {
+                x[r] = _mm_set1_pd(a[r][2 * k]);
+                y[r] = _mm_set1_pd(a[r][2 * k + 1]);
+            }
+            int j = 0;
+            for (; j + 2 <= width; j += 2) {
+                const __m128d e = _mm_loadu_pd(even + j);
+                const __m128d o = _mm_loadu_pd(odd + j);
+                for (int r = 0; r < ROWS_BLOCK; ++r) {
+                    const __m128d p = _mm_mul_pd(_mm_add_pd(x[r], o), _mm_add_pd(y[r], e));
+                    _mm_storeu_pd(out[r] + j, _mm_add_pd(_mm_loadu_pd(out[r] + j), p));
+                }
+            }
+            for (; j < width; ++j) {
+                for (int r = 0; r < ROWS_BLOCK; ++r) {
+                    out[r][j] += (a[r][2 * k] + odd[j]) * (a[r][2 * k + 1] + even[j]);
+                }
+            }
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    static void stripAvx2(double *const *out, const double *const *a,
+            const double *packed, const int pairs, const int width) {
+        for (int k = 0; k < pairs; ++k) {
+            const double *even = packed + (size_t) k * 2 * COLUMNS_BLOCK;
+            const double *odd = even + COLUMNS_BLOCK;
+            __m256d x[ROWS_BLOCK], y[ROWS_BLOCK];
+            for (int r = 0; r < ROWS_BLOCK; ++r) {
+                x[r] = _mm256_set1_pd(a[r][2 * k]);
+                y[r] = _mm256_set1_pd(a[r][2 * k + 1]);
+            }
+            int j = 0;
+            for (; j + 4 <= width; j += 4) {
+                const __m256d e = _mm256_loadu_pd(even + j);
+                const __m256d o = _mm256_loadu_pd(odd + j);
+                for (int r = 0; r < ROWS_BLOCK; ++r) {
+                    const __m256d c = _mm256_loadu_pd(out[r] + j);
+                    _mm256_storeu_pd(out[r] + j, _mm256_fmadd_pd(_mm256_add_pd(x[r], o), _mm256_add_pd(y[r], e), c));
+                }
+            }
+            for (; j < width; ++j) {
+                for (int r = 0; r < ROWS_BLOCK; ++r) {
+                    out[r][j] += (a[r][2 * k] + odd[j]) * (a[r][2 * k + 1] + even[j]);
+                }
+            }
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    static void stripAvx512(double *const *out, const double *const *a,
+            const double *packed, const int pairs, const int width) {
+        for (int k = 0; k < pairs; ++k) {
+            const double *even = packed + (size_t) k * 2 * COLUMNS_BLOCK;
+            const double *odd = even + COLUMNS_BLOCK;
+            __m512d x[ROWS_BLOCK], y[ROWS_BLOCK];
+            for (int r = 0; r < ROWS_BLOCK; ++r) {
+                x[r] = _mm512_set1_pd(a[r][2 * k]);
+                y[r] = _mm512_set1_pd(a[r][2 * k + 1]);
+            }
+            int j = 0;
+            for (; j + 8 <= width; j += 8) {
+                const __m512d e = _mm512_loadu_pd(even + j);
+                const __m512d o = _mm512_loadu_pd(odd + j);
+                for (int r = 0; r < ROWS_BLOCK; ++r) {
+                    const __m512d c = _mm512_loadu_pd(out[r] + j);
+                    _mm512_storeu_pd(out[r] + j, _mm512_fmadd_pd(_mm512_add_pd(x[r], o), _mm512_add_pd(y[r], e), c));
+                }
+            }
+            if (j < width) {
+                const __mmask8 mask = (__mmask8) ((1u << (width - j)) - 1);
+                const __m512d e = _mm512_maskz_loadu_pd(mask, even + j);
+                const __m512d o = _mm512_maskz_loadu_pd(mask, odd + j);
+                for (int r = 0; r < ROWS_BLOCK; ++r) {
+                    const __m512d c = _mm512_maskz_loadu_pd(mask, out[r] + j);
+                    _mm512_mask_storeu_pd(out[r] + j, mask,
+                            _mm512_fmadd_pd(_mm512_add_pd(x[r], o), _mm512_add_pd(y[r], e), c));
+                }
+            }
+        }
+    }
+#endif
+
+    static StripKernel selectStripKernel(const char **name) {
+#ifdef WINOGRAD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            *name = "avx512";
+            return &stripAvx512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            *name = "avx2";
+            return &stripAvx2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            *name = "sse2";
+            return &stripSse2;
+        }
+#endif
+        *name = "scalar";
+        return &stripGeneric<double>;
+    }
+
+    static const char *stripKernelName = "scalar";
+    static const StripKernel stripKernel = selectStripKernel(&stripKernelName);
+
+    // instruction set the vectorized engine runs with on this host
+    const char *vectorLevel() {
+        return stripKernelName;
+    }
+
+    template <typename T>
+    inline void strip(T *const *out, const T *const *a, const T *packed, const int pairs, const int width) {
+        stripGeneric(out, a, packed, pairs, width);
+    }
+
+    inline void strip(double *const *out, const double *const *a, const double *packed,
+            const int pairs, const int width) {
+        stripKernel(out, a, packed, pairs, width);
+    }
+
+    // rowFactor[i] = sum_k first[i][2k] first[i][2k + 1], inside a parallel region
+    template <typename T, typename M>
+    void rowFactors(T *rowFactor, const M &first, const int m, const int d) {
+        #pragma omp for
+        for (int i = 0; i < m; ++i) {
+            const T *row = &first[i][0];
+            T sum = T();
+            for (int k = 0; k < d; ++k) {
+                sum += row[2 * k] * row[2 * k + 1];
+            }
+            rowFactor[i] = sum;
+        }
+    }
+
+    // accumulated row by row, so that j stays the unit stride index
+    template <typename T, typename M>
+    void columnFactors(T *columnFactor, const M &second, const int n, const int d) {
+        #pragma omp for
+        for (int j0 = 0; j0 < n; j0 += COLUMNS_BLOCK) {
+            const int width = n - j0 < COLUMNS_BLOCK ? n - j0 : COLUMNS_BLOCK;
+            for (int j = 0; j < width; ++j) {
+                columnFactor[j0 + j] = T();
+            }
+            for (int k = 0; k < d; ++k) {
+                const T *even = &second[2 * k][j0];
+                const T *odd = &second[2 * k + 1][j0];
+                for (int j = 0; j < width; ++j) {
+                    columnFactor[j0 + j] += even[j] * odd[j];
+                }
+            }
+        }
+    }
+
+    // result = -rowFactor - columnFactor, odd inner size: the last column of
+    // first has no partner and goes in as a plain rank-1 term with lastRow
+    template <typename T, typename M>
+    void initResult(const M &result, const M &first, const T *rowFactor, const T *columnFactor,
+            const T *lastRow, const int m, const int inner, const int n) {
+        #pragma omp for
+        for (int i = 0; i < m; ++i) {
+            T *out = &result[i][0];
+            for (int j = 0; j < n; ++j) {
+                out[j] = -rowFactor[i] - columnFactor[j];
+            }
+            if (inner & 1) {
+                const T x = first[i][inner - 1];
+                for (int j = 0; j < n; ++j) {
+                    out[j] += x * lastRow[j];
+                }
+            }
+        }
+    }
+
+    // one packed strip (pairs k0.., columns j0..) against every row of first
+    template <typename T, typename M>
+    void stripRows(const M &result, const M &first, const int m, const int j0, const int width,
+            const int k0, const int pairs, const T *packed, T *dummyOut, const T *dummyIn) {
+        #pragma omp for
+        for (int i0 = 0; i0 < m; i0 += ROWS_BLOCK) {
+            T *out[ROWS_BLOCK];
+            const T *a[ROWS_BLOCK];
+            for (int r = 0; r < ROWS_BLOCK; ++r) {
+                if (i0 + r < m) {
+                    out[r] = &result[i0 + r][j0];
+                    a[r] = &first[i0 + r][2 * k0];
+                } else {
+                    // only one thread gets the incomplete block
+                    out[r] = dummyOut;
+                    a[r] = dummyIn;
+                }
+            }
+            strip(out, a, packed, pairs, width);
+        }
+    }
+
+    // zero input and scratch output that pad the last, incomplete row block
+    template <typename T>
+    static void dummyRows(T *&dummyOut, T *&dummyIn) {
+        dummyOut = (T *) alignedMalloc(COLUMNS_BLOCK * sizeof(T));
+        dummyIn = (T *) alignedMalloc((size_t) 2 * PAIRS_BLOCK * sizeof(T));
+        for (int k = 0; k < 2 * PAIRS_BLOCK; ++k) {
+            dummyIn[k] = T();
+        }
+    }
+
+    // result (m x n) = first (m x inner) * second (inner x n)
+    template <typename M>
+    void multVectorized(const M &result, const M &first, const M &second,
+            const int m, const int inner, const int n, const bool parallel) {
+        typedef typename ElementOf<M>::type T;
+        const int d = inner / 2;
+        T *rowFactor = (T *) alignedMalloc(m * sizeof(T));
+        T *columnFactor = (T *) alignedMalloc(n * sizeof(T));
+        T *packed = (T *) alignedMalloc((size_t) 2 * PAIRS_BLOCK * COLUMNS_BLOCK * sizeof(T));
+        T *dummyOut, *dummyIn;
+        dummyRows(dummyOut, dummyIn);
+        const T *lastRow = inner & 1 ? &second[inner - 1][0] : NULL;
+
+        #pragma omp parallel if(parallel)
+        {
+            rowFactors(rowFactor, first, m, d);
+            columnFactors(columnFactor, second, n, d);
+            initResult(result, first, rowFactor, columnFactor, lastRow, m, inner, n);
+
+            for (int j0 = 0; j0 < n; j0 += COLUMNS_BLOCK) {
+                const int width = n - j0 < COLUMNS_BLOCK ? n - j0 : COLUMNS_BLOCK;
+                for (int k0 = 0; k0 < d; k0 += PAIRS_BLOCK) {
+                    const int pairs = d - k0 < PAIRS_BLOCK ? d - k0 : PAIRS_BLOCK;
+
+                    #pragma omp single
+                    for (int k = 0; k < pairs; ++k) {
+                        T *even = packed + (size_t) k * 2 * COLUMNS_BLOCK;
+                        T *odd = even + COLUMNS_BLOCK;
+                        const T *evenRow = &second[2 * (k0 + k)][j0];
+                        const T *oddRow = &second[2 * (k0 + k) + 1][j0];
+                        for (int j = 0; j < width; ++j) {
+                            even[j] = evenRow[j];
+                            odd[j] = oddRow[j];
+                        }
+                    }
+
+                    stripRows(result, first, m, j0, width, k0, pairs, packed, dummyOut, dummyIn);
+                }
+            }
+        }
+
+        alignedFree(rowFactor);
+        alignedFree(columnFactor);
+        alignedFree(packed);
+        alignedFree(dummyOut);
+        alignedFree(dummyIn);
+    }
+
+    template <typename T>
+    void multiplyVectorized(T **result, T **first, T **second, const int size) {
+        multVectorized(result, first, second, size, size, size, false);
+    }
+
+    template <typename T>
+    void multiplyVectorizedParallel(T **result, T **first, T **second, const int size) {
+        multVectorized(result, first, second, size, size, size, true);
+    }
+
+    template <typename T>
+    void multiplyVectorized(BasicMatrix<T> &result, const BasicMatrix<T> &first, const BasicMatrix<T> &second) {
+        multVectorized(result, first, second, result.rows, first.cols, result.cols, false);
+    }
+
+    template <typename T>
+    void multiplyVectorizedParallel(BasicMatrix<T> &result, const BasicMatrix<T> &first,
+            const BasicMatrix<T> &second) {
+        multVectorized(result, first, second, result.rows, first.cols, result.cols, true);
+    }
+
+    /* Prepared right operand
+    *       for many products first * second with the same second: its column
+    *       factors and every packed strip are computed once and kept, a
+    *       multiply then only pays for the row factors of first and the
+    *       strip kernel itself
+    *   The strips are stored in the order the multiply walks them, pair k of
+    *   column block jb at (jb * d + k) * 2 * COLUMNS_BLOCK.
+    *   The source is not copied. Before every multiply a fingerprint (shape,
+    *   address and up to FINGERPRINT_SAMPLES elements spread over the matrix)
+    *   is compared and the cache rebuilt if it differs; an edit that misses
+    *   every sample goes unnoticed, call prepare() after such edits.
+    *   Several threads may multiply with one prepared operand at a time, as
+    *   long as none of them changes the source meanwhile: the check and a
+    *   rebuild run under a lock, and a multiply holds on to the cache it
+    *   started with (shared_ptr), so a rebuild never frees it underneath.
+    */
+    const int FINGERPRINT_SAMPLES = 1024;
+
+    class PreparedOperand {
+    public:
+        explicit PreparedOperand(const Matrix &second)
+                : source(second.data, second.rows, second.cols, second.stride) {
+            prepare();
+        }
+
+        // createMatrix() layout, rows contiguous
+        PreparedOperand(double **second, const int rows, const int cols)
+                : source(second[0], rows, cols, cols) {
+            prepare();
+        }
+
+        PreparedOperand(const PreparedOperand &) = delete;
+        PreparedOperand &operator=(const PreparedOperand &) = delete;
+
+        int rows() const {
+            return source.rows;
+        }
+
+        int cols() const {
+            return source.cols;
+        }
+
+        // recomputes everything from the source
+        void prepare() {
+            std::shared_ptr<const Cache> fresh(build());
+            std::lock_guard<std::mutex> guard(lock);
+            cache = fresh;
+        }
+
+        // rebuilds the cache if the source no longer matches it
+        void update() {
+            current();
+        }
+
+        // result (m x n) = first (m x inner) * prepared (inner x n), update() included
+        template <typename M>
+        void multiply(const M &result, const M &first, const int m, const bool parallel) {
+            const std::shared_ptr<const Cache> prepared = current();
+            const int inner = source.rows, n = source.cols, d = inner / 2;
+            double *rowFactor = (double *) alignedMalloc((m > 0 ? m : 1) * sizeof(double));
+            double *dummyOut, *dummyIn;
+            dummyRows(dummyOut, dummyIn);
+
+            #pragma omp parallel if(parallel)
+            {
+                rowFactors(rowFactor, first, m, d);
+                initResult(result, first, rowFactor, prepared->columnFactor, prepared->lastRow, m, inner, n);
+
+                for (int j0 = 0, jb = 0; j0 < n; j0 += COLUMNS_BLOCK, ++jb) {
+                    const int width = n - j0 < COLUMNS_BLOCK ? n - j0 : COLUMNS_BLOCK;
+                    for (int k0 = 0; k0 < d; k0 += PAIRS_BLOCK) {
+                        const int pairs = d - k0 < PAIRS_BLOCK ? d - k0 : PAIRS_BLOCK;
+                        const double *strip = prepared->packed + ((size_t) jb * d + k0) * 2 * COLUMNS_BLOCK;
+                        stripRows(result, first, m, j0, width, k0, pairs, strip, dummyOut, dummyIn);
+                    }
+                }
+            }
+
+            alignedFree(rowFactor);
+            alignedFree(dummyOut);
+            alignedFree(dummyIn);
+        }
+
+    private:
+        struct Cache {
+            double *columnFactor;
+            double *packed;
+            double *lastRow;
+            uint64_t hash;
+
+            Cache() : columnFactor(NULL), packed(NULL), lastRow(NULL), hash(0) {}
+
+            ~Cache() {
+                alignedFree(columnFactor);
+                alignedFree(packed);
+                alignedFree(lastRow);
+            }
+
+            Cache(const Cache &) = delete;
+            Cache &operator=(const Cache &) = delete;
+        };
+
+        Matrix source;
+        std::mutex lock;
+        std::shared_ptr<const Cache> cache;
+
+        Cache *build() const {
+            const int inner = source.rows, n = source.cols, d = inner / 2;
+            const int blocks = (n + COLUMNS_BLOCK - 1) / COLUMNS_BLOCK;
+            Cache *fresh = new Cache();
+            double *columnFactor = fresh->columnFactor = (double *) alignedMalloc((n > 0 ? n : 1) * sizeof(double));
+            double *packed = fresh->packed
+                    = (double *) alignedMalloc(((size_t) blocks * d * 2 * COLUMNS_BLOCK + 1) * sizeof(double));
+            fresh->lastRow = (double *) alignedMalloc((n > 0 ? n : 1) * sizeof(double));
+
+            #pragma omp parallel
+            {
+                columnFactors(columnFactor, source, n, d);
+
+                #pragma omp for
+                for (int jb = 0; jb < blocks; ++jb) {
+                    const int j0 = jb * COLUMNS_BLOCK;
+                    const int width = n - j0 < COLUMNS_BLOCK ? n - j0 : COLUMNS_BLOCK;
+                    for (int k = 0; k < d; ++k) {
+                        double *even = packed + ((size_t) jb * d + k) * 2 * COLUMNS_BLOCK;
+                        double *odd = even + COLUMNS_BLOCK;
+                        for (int j = 0; j < width; ++j) {
+                            even[j] = source[2 * k][j0 + j];
+                            odd[j] = source[2 * k + 1][j0 + j];
+                        }
+                    }
+                }
+            }
+            if (inner & 1) {
+                memcpy(fresh->lastRow, source[inner - 1], n * sizeof(double));
+            }
+            fresh->hash = fingerprint();
+            return fresh;
+        }
+
+        // the cache matching the source, rebuilt first if it does not
+        std::shared_ptr<const Cache> current() {
+            std::lock_guard<std::mutex> guard(lock);
+            if (fingerprint() != cache->hash) {
+                cache.reset(build());
+            }
+            return cache;
+        }
+
+        // FNV-1a over shape, address and a sample of the element bits
+        uint64_t fingerprint() const {
+            uint64_t h = 14695981039346656037ull;
+            const uint64_t header[4] = {(uint64_t) (uintptr_t) source.data, (uint64_t) source.rows,
+                                        (uint64_t) source.cols, (uint64_t) source.stride};
+            for (int i = 0; i < 4; ++i) {
+                h = (h ^ header[i]) * 1099511628211ull;
+            }
+            const long long elements = (long long) source.rows * source.cols;
+            const int samples = elements < FINGERPRINT_SAMPLES ? (int) elements : FINGERPRINT_SAMPLES;
+            for (int s = 0; s < samples; ++s) {
+                // spread over all rows, columns walk with a large odd step
+                const int i = (int) ((long long) s * source.rows / samples);
+                const int j = (int) (((long long) s * 7919) % source.cols);
+                uint64_t bits;
+                memcpy(&bits, &source[i][j], sizeof(bits));
+                h = (h ^ bits) * 1099511628211ull;
+            }
+            return h;
+        }
+    };
+
+    void multiplyPrepared(Matrix &result, const Matrix &first, PreparedOperand &second) {
+        second.multiply(result, first, result.rows, false);
+    }
+
+    void multiplyPreparedParallel(Matrix &result, const Matrix &first, PreparedOperand &second) {
+        second.multiply(result, first, result.rows, true);
+    }
+
+    void multiplyPrepared(double **result, double **first, PreparedOperand &second, const int size) {
+        second.multiply(result, first, size, false);
+    }
+
+    void multiplyPreparedParallel(double **result, double **first, PreparedOperand &second, const int size) {
+        second.multiply(result, first, size, true);
+    }
+}
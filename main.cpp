@@ -1,16 +1,32 @@
 #include <stdio.h>
 #include <omp.h>
+#include <conio.h>
 #include "lab6/winogradMultiplication.cpp"
+#include "lab6/winogradVectorized.cpp"
 #include "lab6/recursiveMultiplication.cpp"
 #include "lab6/recursiveMultiplicationInPlace.cpp"
+#include "lab6/strassenMultiplication.cpp"
+#include "lab6/numaMultiplication.cpp"
+#include "lab6/outOfCoreMultiplication.cpp"
+#include "lab6/batchedMultiplication.cpp"
+#include "lab6/mixedPrecision.cpp"
+#include "lab6/autotune.cpp"
+#include "lab6/asyncMultiplication.cpp"
+#include "lab6/structuredMultiplication.cpp"
+#include "lab6/distributedMultiplication.cpp"
+#include "lab6/matrixIO.h"
 
-#define sizesSize 15
-const int sizes[sizesSize] = {8,16,32,50,100,150,256,300,512,600,700,800,900,1024, 1500};
+// element type of the demo: double, float, int32_t, int64_t, std::complex<double>, ...
+#ifndef ELEMENT_TYPE
+#define ELEMENT_TYPE double
+#endif
+typedef ELEMENT_TYPE Element;
 
-void testMultiplicationWithPrint(const int size, void (*multiply)(double **, double **, double **, const int)){
-    double **first = createMatrix(size, size);
-    double **second = createMatrix(size, size);
-    double **result = createMatrix(size, size);
+template <typename T>
+void testMultiplicationWithPrint(const int size, void (*multiply)(T **, T **, T **, const int)){
+    T **first = createMatrix<T>(size, size);
+    T **second = createMatrix<T>(size, size);
+    T **result = createMatrix<T>(size, size);
 
     for (int i = 0; i < size; i++) {
         for (int j = 0; j < size; j++) {
@@ -33,53 +49,36 @@ void testMultiplicationWithPrint(const int size, void (*multiply)(double **, dou
     freeMatrix(result);
 }
 
-void testMultiplication(
-        void (*multiplySerial)(double **, double **, double **, const int),
-        void (*multiplyParallel)(double **, double **, double **, const int)
-){
-    double t_start, t_finish;
-    for(int k = 0; k < sizesSize; k++){
-        const int size = sizes[k];
-        std::cout << size;
-        double **first = createMatrix(size, size);
-        double **second = createMatrix(size, size);
-        double **resultSerial = createMatrix(size, size);
-        double **resultParallel = createMatrix(size, size);
-
-        for (int i = 0; i < size; i++) {
-            for (int j = 0; j < size; j++) {
-                first[i][j] = i + 1;
-            }
-        }
-        for (int i = 0; i < size; i++) {
-            for (int j = 0; j < size; j++) {
-                second[i][j] = j + 1;
-            }
-        }
-
-        t_start = omp_get_wtime();
-        multiplyParallel(resultSerial, first, second, size);
-        t_finish = omp_get_wtime();
-        std::cout << "\t" << (t_finish-t_start);
-
-        t_start = omp_get_wtime();
-        multiplySerial(resultParallel, first, second, size);
-        t_finish = omp_get_wtime();
-        std::cout << "\t" << t_finish-t_start;
-
-        std::cout << "\t" << isCorrect(resultSerial, resultParallel, size, size) << std::endl;
-
-        freeMatrix(first);
-        freeMatrix(second);
-        freeMatrix(resultSerial);
-        freeMatrix(resultParallel);
+// first * second from files (binary or text, see matrixIO.h), result to a file or as CSV to stdout
+template <typename T>
+int multiplyFiles(const char *firstPath, const char *secondPath, const char *resultPath) {
+    BasicMatrix<T> first, second;
+    if (!matrixIO::read(firstPath, first) || !matrixIO::read(secondPath, second)) {
+        perror("read");
+        return 1;
     }
-
+    if (first.cols != second.rows) {
+        fprintf(stderr, "%d x %d times %d x %d\n", first.rows, first.cols, second.rows, second.cols);
+        return 1;
+    }
+    BasicMatrix<T> result(first.rows, second.cols);
+    structured::multiply(result, first, second);
+    const bool written = resultPath != NULL ? matrixIO::write(resultPath, result)
+                                            : matrixIO::writeText("/dev/stdout", result);
+    if (!written) {
+        perror("write");
+        return 1;
+    }
+    return 0;
 }
 
-int main() {
-//    testMultiplication(&winograd::multiplySerial, &winograd::multiplyParallel);
-    testMultiplicationWithPrint(8, &winograd::multiplySerial);
+int main(int argc, char **argv) {
+    // tuned by AlgorithmsII_Cpp_Benchmark --tune autotune.txt, blocked kernel without it
+    autotune::load(autotune::defaultPath());
+    if (argc >= 3) {
+        return multiplyFiles<Element>(argv[1], argv[2], argc > 3 ? argv[3] : NULL);
+    }
+    testMultiplicationWithPrint<Element>(8, &autotune::multiply);
     getch();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <vector>
+#include "../lab6/asyncMultiplication.cpp"
+
+/* async::multiply / multiplyChain against kernel::multiply
+*   chainOrder() on the CLRS 15.2 example, a rectangular chain whose panels
+*   pipeline through intermediate products, a chain of one factor (a copy),
+*   a shape mismatch (invalid future) and two futures in flight at once.
+*   Small integer inputs, so every product is exact.
+*/
+static int failures = 0;
+
+static void expect(const bool condition, const char *what) {
+    if (!condition) {
+        ++failures;
+        printf("failed: %s\n", what);
+    }
+}
+
+static void fill(const Matrix &matrix, const int salt) {
+    for (int i = 0; i < matrix.rows; ++i) {
+        for (int j = 0; j < matrix.cols; ++j) {
+            matrix[i][j] = (double) ((i * 7 + j * 3 + salt) % 5) - 2;
+        }
+    }
+}
+
+static bool same(const Matrix &a, const Matrix &b) {
+    if (a.rows != b.rows || a.cols != b.cols) {
+        return false;
+    }
+    for (int i = 0; i < a.rows; ++i) {
+        for (int j = 0; j < a.cols; ++j) {
+            if (a[i][j] != b[i][j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void testChainOrder() {
+    const int dims[] = {10, 100, 5, 50};
+    const async::ChainOrder order = async::chainOrder(std::vector<int>(dims, dims + 4));
+    expect(order.cost == 7500, "chainOrder cost of 10x100 * 100x5 * 5x50 is 7500");
+    // ((A1 A2) A3)
+    expect(order.split[0][2] == 1, "chainOrder splits after the second factor");
+}
+
+static void testChain() {
+    // tiles smaller than the shapes, so panels of one product feed the next
+    async::tileRows = 16;
+    async::tileCols = 32;
+    const int dims[] = {70, 45, 130, 9, 66};
+    std::vector<Matrix> factors;
+    std::vector<const Matrix *> chain;
+    factors.reserve(4);
+    for (int f = 0; f < 4; ++f) {
+        factors.emplace_back(dims[f], dims[f + 1]);
+        fill(factors.back(), f);
+    }
+    for (int f = 0; f < 4; ++f) {
+        chain.push_back(&factors[f]);
+    }
+    Matrix expected(dims[0], dims[2]);
+    kernel::multiply(expected, factors[0], factors[1]);
+    for (int f = 2; f < 4; ++f) {
+        Matrix next(dims[0], dims[f + 1]);
+        kernel::multiply(next, expected, factors[f]);
+        expected = std::move(next);
+    }
+    async::Future<double> future = async::multiplyChain(chain);
+    expect(future.valid(), "rectangular chain gives a valid future");
+    expect(same(future.get(), expected), "rectangular chain matches sequential kernel products");
+    expect(future.ready(), "future is ready after get()");
+}
+
+static void testOneFactor() {
+    Matrix only(5, 7);
+    fill(only, 3);
+    async::Future<double> future = async::multiplyChain(std::vector<const Matrix *>(1, &only));
+    expect(future.valid() && same(future.get(), only), "chain of one factor equals the factor");
+    expect(future.get().data != only.data, "chain of one factor is a copy");
+}
+
+static void testMismatch() {
+    Matrix a(4, 5), b(6, 3);
+    std::vector<const Matrix *> chain;
+    chain.push_back(&a);
+    chain.push_back(&b);
+    async::Future<double> future = async::multiplyChain(chain);
+    expect(!future.valid(), "shape mismatch gives an invalid future");
+    expect(!future.ready(), "invalid future is never ready");
+    expect(!async::multiplyChain(std::vector<const Matrix *>()).valid(), "empty chain gives an invalid future");
+}
+
+static void testInFlight() {
+    Matrix a(90, 60), b(60, 110), c(110, 40), d(40, 75);
+    fill(a, 1);
+    fill(b, 2);
+    fill(c, 3);
+    fill(d, 4);
+    async::Future<double> first = async::multiply(a, b);
+    async::Future<double> second = async::multiply(c, d);
+    Matrix ab(90, 110), cd(110, 75);
+    kernel::multiply(ab, a, b);
+    kernel::multiply(cd, c, d);
+    expect(same(second.get(), cd), "second of two futures in flight");
+    expect(same(first.get(), ab), "first of two futures in flight");
+}
+
+int main() {
+    testChainOrder();
+    testChain();
+    testOneFactor();
+    testMismatch();
+    testInFlight();
+    printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
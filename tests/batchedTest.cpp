@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <vector>
+#include "../lab6/batchedMultiplication.cpp"
+#include "../lab6/utils.h"
+
+/* batched::multiply against kernel::multiply, product by product
+*   Shapes with n and k from the compile-time set (k 16, n 32), sizes that
+*   take the run-time fallback (k 13, n 10) and one above SMALL_MAX (blocked
+*   kernel), through the strided, pointer-array, BasicMatrix and T*** entry
+*   points. Small integer inputs, so every product is exact.
+*/
+static int failures = 0;
+
+static void fill(double *data, const size_t count, const int salt) {
+    for (size_t e = 0; e < count; ++e) {
+        data[e] = (double) ((e * 7 + salt) % 17) - 8;
+    }
+}
+
+// C[b] is m x n with rows n apart, C + b * m * n
+static void compare(const char *layout, const double *C, const double *A, const double *B,
+        const int m, const int k, const int n, const int batch) {
+    Matrix expected(m, n);
+    for (int b = 0; b < batch; ++b) {
+        const Matrix a((double *) A + (size_t) b * m * k, m, k, k), bb((double *) B + (size_t) b * k * n, k, n, n);
+        kernel::multiply(expected, a, bb);
+        const Matrix c((double *) C + (size_t) b * m * n, m, n, n);
+        bool same = true;
+        for (int i = 0; i < m; ++i) {
+            for (int j = 0; j < n; ++j) {
+                same = same && c[i][j] == expected[i][j];
+            }
+        }
+        if (!same) {
+            ++failures;
+            printf("%s m=%d k=%d n=%d: product %d differs\n", layout, m, k, n, b);
+        }
+    }
+}
+
+static void testShape(const int m, const int k, const int n, const int batch) {
+    std::vector<double> A((size_t) batch * m * k), B((size_t) batch * k * n), C((size_t) batch * m * n);
+    fill(A.data(), A.size(), 1);
+    fill(B.data(), B.size(), 5);
+
+    batched::multiply(C.data(), A.data(), B.data(), m, k, n, n, k, n,
+                      (ptrdiff_t) m * n, (ptrdiff_t) m * k, (ptrdiff_t) k * n, batch);
+    compare("strided", C.data(), A.data(), B.data(), m, k, n, batch);
+
+    std::vector<double *> c(batch);
+    std::vector<const double *> a(batch), b(batch);
+    for (int p = 0; p < batch; ++p) {
+        c[p] = C.data() + (size_t) p * m * n;
+        a[p] = A.data() + (size_t) p * m * k;
+        b[p] = B.data() + (size_t) p * k * n;
+    }
+    fill(C.data(), C.size(), 3);
+    batched::multiply(c.data(), a.data(), b.data(), m, k, n, n, k, n, batch);
+    compare("pointer array", C.data(), A.data(), B.data(), m, k, n, batch);
+
+    std::vector<Matrix> cm, am, bm;
+    cm.reserve(batch);
+    am.reserve(batch);
+    bm.reserve(batch);
+    for (int p = 0; p < batch; ++p) {
+        cm.emplace_back(c[p], m, n, n);
+        am.emplace_back((double *) a[p], m, k, k);
+        bm.emplace_back((double *) b[p], k, n, n);
+    }
+    fill(C.data(), C.size(), 3);
+    batched::multiply(cm.data(), am.data(), bm.data(), batch);
+    compare("BasicMatrix", C.data(), A.data(), B.data(), m, k, n, batch);
+}
+
+static void testArrays(const int size, const int batch) {
+    std::vector<double **> result(batch), first(batch), second(batch);
+    for (int p = 0; p < batch; ++p) {
+        result[p] = createMatrix(size, size);
+        first[p] = createMatrix(size, size);
+        second[p] = createMatrix(size, size);
+        fill(first[p][0], (size_t) size * size, p);
+        fill(second[p][0], (size_t) size * size, p + 2);
+    }
+    batched::multiply(result.data(), first.data(), second.data(), size, batch);
+    for (int p = 0; p < batch; ++p) {
+        compare("T***", result[p][0], first[p][0], second[p][0], size, size, size, 1);
+        freeMatrix(result[p]);
+        freeMatrix(first[p]);
+        freeMatrix(second[p]);
+    }
+}
+
+int main() {
+    testShape(5, 16, 32, 9);
+    testShape(7, 13, 10, 9);
+    testShape(70, 80, 65, 3);
+    testArrays(16, 5);
+    testArrays(13, 5);
+    testArrays(70, 2);
+    printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../lab6/matrixIO.h"
+
+/* matrixIO::parseValue against strtod, bit for bit
+*   19 digit mantissas with small negative exponents (the long mantissa
+*   branch of the 128 bit path), then random doubles printed with 10 .. 17
+*   significant digits.
+*/
+static int mismatches = 0;
+
+static void check(const char *text) {
+    double parsed, expected = strtod(text, NULL);
+    const char *end = text + strlen(text);
+    if (matrixIO::parseValue(text, end, parsed) != end || memcmp(&parsed, &expected, sizeof(double)) != 0) {
+        if (++mismatches <= 10) {
+            printf("%s: parsed %.17g, strtod %.17g\n", text, parsed, expected);
+        }
+    }
+}
+
+int main() {
+    const char *fixed[] = {"123456789012345678.9", "1234567890123456789e-1", "9999999999999999999e-1",
+                           "9999999999999999999e-2", "1000000000000000000e-1", "18446744073709551615e-2",
+                           "9007199254740993", "0.30000000000000004", "2.2250738585072014e-308"};
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); ++i) {
+        check(fixed[i]);
+    }
+    uint64_t state = 42;
+    char text[64];
+    for (int n = 0; n < 1000000; ++n) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        const uint64_t mantissa = 1000000000000000000ull + (state >> 1) % 9000000000000000000ull;
+        snprintf(text, sizeof(text), "%llue-%d", (unsigned long long) mantissa, 1 + n % 19);
+        check(text);
+        double value;
+        memcpy(&value, &state, sizeof(value));
+        if (value == value && value - value == 0) {
+            snprintf(text, sizeof(text), "%.*g", 10 + n % 8, value);
+            check(text);
+        }
+    }
+    printf("%d mismatches\n", mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+#include <errno.h>
+#include <stdio.h>
+#include "../lab6/outOfCoreMultiplication.cpp"
+#include "../lab6/utils.h"
+
+/* outOfCore::multiply against kernel::multiply
+*   Tiled files whose tiles do not divide the shapes (partial edge tiles on
+*   every side) through the MappedMatrix overload, serial and parallel, and
+*   row-major files through both overloads: mapped with explicit tile edges,
+*   and by path, which tiles them with the 512 x 512 default. A tile grid
+*   mismatch has to fail with EINVAL. The files are written to the working
+*   directory and removed. Small integer inputs, so every product is exact.
+*/
+static int failures = 0;
+
+static const char *FIRST = "outOfCoreFirst.mat";
+static const char *SECOND = "outOfCoreSecond.mat";
+static const char *RESULT = "outOfCoreResult.mat";
+
+static void fill(const Matrix &matrix, const int salt) {
+    for (int i = 0; i < matrix.rows; ++i) {
+        for (int j = 0; j < matrix.cols; ++j) {
+            matrix[i][j] = (double) ((i * 7 + j * 3 + salt) % 9) - 4;
+        }
+    }
+}
+
+// path gets a copy of matrix; tile edges <= 0 write it row-major
+static bool write(const char *path, const Matrix &matrix, const int tileRows, const int tileCols) {
+    MappedMatrix file;
+    if (!file.create(path, matrix.rows, matrix.cols, tileRows, tileCols)) {
+        return false;
+    }
+    double **rows = createMatrix<double>(matrix.rows, matrix.cols);
+    for (int i = 0; i < matrix.rows; ++i) {
+        for (int j = 0; j < matrix.cols; ++j) {
+            rows[i][j] = matrix[i][j];
+        }
+    }
+    file.copyFrom(rows);
+    file.flush(true);
+    freeMatrix(rows);
+    return true;
+}
+
+static void compare(const char *name, const MappedMatrix &result, const Matrix &expected) {
+    if (result.rows() != expected.rows || result.cols() != expected.cols) {
+        ++failures;
+        printf("%s: result is %d x %d, expected %d x %d\n", name, result.rows(), result.cols(), expected.rows, expected.cols);
+        return;
+    }
+    double **rows = createMatrix<double>(expected.rows, expected.cols);
+    result.copyTo(rows);
+    bool same = true;
+    for (int i = 0; i < expected.rows; ++i) {
+        for (int j = 0; j < expected.cols; ++j) {
+            same = same && rows[i][j] == expected[i][j];
+        }
+    }
+    freeMatrix(rows);
+    if (!same) {
+        ++failures;
+        printf("%s: product differs\n", name);
+    }
+}
+
+static void expect(const bool condition, const char *what) {
+    if (!condition) {
+        ++failures;
+        printf("failed: %s\n", what);
+    }
+}
+
+// first (m x k) in tr x tk tiles, second (k x n) in tk x tc tiles
+static void testTiled(const int m, const int k, const int n, const int tr, const int tk, const int tc,
+        const bool parallel) {
+    Matrix A(m, k), B(k, n), expected(m, n);
+    fill(A, 1);
+    fill(B, 2);
+    kernel::multiply(expected, A, B);
+    expect(write(FIRST, A, tr, tk) && write(SECOND, B, tk, tc), "tiled inputs are written");
+    MappedMatrix first, second, result;
+    expect(first.open(FIRST, false) && second.open(SECOND, false) && result.create(RESULT, m, n, tr, tc),
+           "tiled files are mapped");
+    expect(outOfCore::multiply(result, first, second, parallel), "tiled multiply succeeds");
+    compare(parallel ? "tiled, parallel" : "tiled, serial", result, expected);
+}
+
+static void testRowMajor(const int m, const int k, const int n) {
+    Matrix A(m, k), B(k, n), expected(m, n);
+    fill(A, 3);
+    fill(B, 4);
+    kernel::multiply(expected, A, B);
+    expect(write(FIRST, A, 0, 0) && write(SECOND, B, 0, 0), "row-major inputs are written");
+
+    MappedMatrix first, second, result;
+    expect(first.open(FIRST, false, 48, 40) && second.open(SECOND, false, 40, 56)
+           && result.create(RESULT, m, n, 0, 0) && result.open(RESULT, true, 48, 56), "row-major files are mapped");
+    expect(outOfCore::multiply(result, first, second), "row-major multiply succeeds");
+    compare("row-major, mapped", result, expected);
+
+    expect(outOfCore::multiply(RESULT, FIRST, SECOND), "row-major multiply by path succeeds");
+    MappedMatrix written;
+    expect(written.open(RESULT, false), "result written by path opens");
+    compare("row-major, by path", written, expected);
+}
+
+static void testMismatch() {
+    Matrix A(30, 20), B(20, 25);
+    fill(A, 5);
+    fill(B, 6);
+    expect(write(FIRST, A, 8, 8) && write(SECOND, B, 6, 8), "mismatched inputs are written");
+    MappedMatrix first, second, result;
+    expect(first.open(FIRST, false) && second.open(SECOND, false) && result.create(RESULT, 30, 25, 8, 8),
+           "mismatched files are mapped");
+    errno = 0;
+    const bool done = outOfCore::multiply(result, first, second);
+    expect(!done && errno == EINVAL, "tile grid mismatch fails with EINVAL");
+}
+
+int main() {
+    testTiled(150, 130, 170, 64, 48, 80, false);
+    testTiled(150, 130, 170, 64, 48, 80, true);
+    testTiled(100, 100, 100, 100, 33, 7, true);
+    // above the 512 default, so the by path product has partial edge tiles too
+    testRowMajor(530, 70, 520);
+    testMismatch();
+    remove(FIRST);
+    remove(SECOND);
+    remove(RESULT);
+    printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
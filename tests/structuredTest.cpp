@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include "../lab6/winogradMultiplication.cpp"
+#include "../lab6/winogradVectorized.cpp"
+#include "../lab6/recursiveMultiplication.cpp"
+#include "../lab6/recursiveMultiplicationInPlace.cpp"
+#include "../lab6/strassenMultiplication.cpp"
+#include "../lab6/numaMultiplication.cpp"
+#include "../lab6/autotune.cpp"
+#include "../lab6/structuredMultiplication.cpp"
+
+/* structured::multiply against kernel::multiply, one operand per Kind
+*   Every case checks the Kind analyze() gives the structured operand, then
+*   the product over a result filled with garbage (every element has to be
+*   written). Sparse and blocked sparse left, sparse right, banded left and
+*   right, lower left, upper right, A * A^T, an all-zero operand and the T**
+*   overload. Small integer inputs, so every path is exact.
+*/
+static int failures = 0;
+
+// 1 .. 5 where keep(i, j), 0 elsewhere
+template <typename Keep>
+static void fill(const Matrix &matrix, const int salt, Keep keep) {
+    for (int i = 0; i < matrix.rows; ++i) {
+        for (int j = 0; j < matrix.cols; ++j) {
+            matrix[i][j] = keep(i, j) ? (double) ((i * 7 + j * 3 + salt) % 5 + 1) : 0;
+        }
+    }
+}
+
+static bool dense(int, int) {
+    return true;
+}
+
+static bool sparse(const int i, const int j) {
+    return (i * 31 + j * 17) % 53 == 0;
+}
+
+// whole 4 x 4 tiles, about one in twelve
+static bool blocks(const int i, const int j) {
+    return (i / 4 * 5 + j / 4 * 3) % 12 == 0;
+}
+
+// lower bandwidth 40, upper 60
+static bool band(const int i, const int j) {
+    return j - i <= 60 && i - j <= 40;
+}
+
+static bool lower(const int i, const int j) {
+    return j <= i;
+}
+
+static bool upper(const int i, const int j) {
+    return j >= i;
+}
+
+static bool zero(int, int) {
+    return false;
+}
+
+static void compare(const char *name, const Matrix &A, const Matrix &B) {
+    Matrix expected(A.rows, B.cols), result(A.rows, B.cols);
+    kernel::multiply(expected, A, B);
+    result.fill(-7);
+    structured::multiply(result, A, B);
+    for (int i = 0; i < A.rows; ++i) {
+        for (int j = 0; j < B.cols; ++j) {
+            if (result[i][j] != expected[i][j]) {
+                ++failures;
+                printf("%s: C[%d][%d] = %g, expected %g\n", name, i, j, result[i][j], expected[i][j]);
+                return;
+            }
+        }
+    }
+}
+
+static void expectKind(const char *name, const Matrix &operand, const bool left, const structured::Kind kind) {
+    const structured::Kind found = structured::analyze(operand, operand.rows, operand.cols, left).kind;
+    if (found != kind) {
+        ++failures;
+        printf("%s: analyze() gives %s, expected %s\n", name, structured::kindNames[found], structured::kindNames[kind]);
+    }
+}
+
+template <typename KeepA, typename KeepB>
+static void testCase(const char *name, const int m, const int k, const int n,
+        KeepA keepA, KeepB keepB, const bool left, const structured::Kind kind) {
+    Matrix A(m, k), B(k, n);
+    fill(A, 1, keepA);
+    fill(B, 2, keepB);
+    expectKind(name, left ? A : B, left, kind);
+    compare(name, A, B);
+}
+
+static void testTranspose() {
+    Matrix A(150, 90), B(90, 150);
+    fill(A, 3, dense);
+    for (int i = 0; i < A.rows; ++i) {
+        for (int j = 0; j < A.cols; ++j) {
+            B[j][i] = A[i][j];
+        }
+    }
+    expectKind("A * A^T", A, true, structured::DENSE);
+    if (!structured::isTranspose(A, B, A.rows, A.cols)) {
+        ++failures;
+        printf("A * A^T: isTranspose() is false\n");
+    }
+    compare("A * A^T", A, B);
+}
+
+static void testArrays() {
+    const int size = 120;
+    double **result = createMatrix(size, size), **first = createMatrix(size, size), **second = createMatrix(size, size);
+    const Matrix a(first[0], size, size, size), b(second[0], size, size, size), c(result[0], size, size, size);
+    fill(a, 4, sparse);
+    fill(b, 5, dense);
+    c.fill(-7);
+    expectKind("T**", a, true, structured::SPARSE);
+    structured::multiply(result, first, second, size);
+    Matrix expected(size, size);
+    kernel::multiply(expected, a, b);
+    bool same = true;
+    for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < size; ++j) {
+            same = same && result[i][j] == expected[i][j];
+        }
+    }
+    if (!same) {
+        ++failures;
+        printf("T**: product differs\n");
+    }
+    freeMatrix(result);
+    freeMatrix(first);
+    freeMatrix(second);
+}
+
+int main() {
+    // several panels per operand
+    structured::panel = 16;
+    testCase("sparse left", 200, 180, 70, sparse, dense, true, structured::SPARSE);
+    testCase("sparse right", 70, 180, 200, dense, sparse, false, structured::SPARSE);
+    testCase("block sparse", 200, 180, 70, blocks, dense, true, structured::BLOCK_SPARSE);
+    testCase("banded left", 400, 400, 50, band, dense, true, structured::BANDED);
+    testCase("banded right", 50, 400, 400, dense, band, false, structured::BANDED);
+    testCase("lower", 300, 300, 60, lower, dense, true, structured::LOWER);
+    testCase("upper", 60, 300, 300, dense, upper, false, structured::UPPER);
+    // an empty band: nothing to multiply, C is cleared
+    testCase("all zero", 100, 80, 90, zero, dense, true, structured::BANDED);
+    testTranspose();
+    testArrays();
+    printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}